@@ -4,6 +4,11 @@
 #include <set>
 #include <random>
 #include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <thread>
 using namespace std;
 
 // Returns a random value between [1, m]
@@ -11,20 +16,233 @@ using namespace std;
 
 //-----------------------------------------------------------------------------
 void printUsage(char *progname) {
-  cerr << "Usage: " << progname << " <V> <E> <L> <b> <seed>" << endl;
+  cerr << "Usage: " << progname << " [--fast] [--threads=N] <V> <E> <L> <b> <seed>" << endl;
   cerr << "  V: number of stations (vertices)" << endl;
   cerr << "  E: number of connections (edges)" << endl;
   cerr << "  L: number of lines (colors)" << endl;
   cerr << "  b: all stations be connected? (optional, 0/1) E >= V" << endl;
   cerr << "  seed: random seed generator (opcional)" << endl;
+  cerr << "  --fast: parallel streaming generator (same seed, same output)" << endl;
+  cerr << "  --threads=N: worker threads for --fast (default: all cores)" << endl;
   exit(1);
 }
 
+//-----------------------------------------------------------------------------
+// Fast mode. Every line owns a SplitMix64 stream derived from (seed, line),
+// so the output only depends on the seed and never on the thread count.
+struct SplitMix64 {
+  uint64_t state;
+
+  explicit SplitMix64(uint64_t seed) : state(seed) {}
+
+  uint64_t next() {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+  }
+
+  // Uniform value in [0, n)
+  uint32_t below(uint32_t n) {
+    return (uint32_t)(((next() >> 32) * (uint64_t)n) >> 32);
+  }
+};
+
+static SplitMix64 lineStream(int seed, int line, uint64_t salt) {
+  SplitMix64 mix((uint64_t)(uint32_t)seed * 0x9E3779B97F4A7C15ULL ^ salt);
+  mix.state ^= mix.next() + (uint64_t)line;
+  return SplitMix64(mix.next());
+}
+
+// Runs work(first, last) over [0, count) split into one slice per thread
+template<typename Work>
+static void parallelFor(int count, int numThreads, const Work& work) {
+  if (numThreads <= 1 || count < 2) {
+    work(0, count);
+    return;
+  }
+  vector<thread> workers;
+  int step = (count + numThreads - 1) / numThreads;
+  for (int first = 0; first < count; first += step)
+    workers.emplace_back(work, first, min(count, first + step));
+  for (thread& t : workers) t.join();
+}
+
+// Draws new distinct stations for a line. Sparse lines use rejection
+// against a per-thread bitmap of 1..V, which stays cache resident; once a
+// line would cover half of the stations a partial Fisher-Yates over the
+// stations it is missing takes over. The bitmap is cleared on the way out.
+struct StationSampler {
+  int V;
+  vector<uint64_t> marked;
+  vector<int> missing;
+
+  explicit StationSampler(int V) : V(V), marked(V / 64 + 1, 0) {}
+
+  bool test(int s) const { return marked[s >> 6] >> (s & 63) & 1; }
+  void mark(int s) { marked[s >> 6] |= 1ULL << (s & 63); }
+
+  void extend(vector<int>& out, int extra, SplitMix64& rng) {
+    for (int s : out) mark(s);
+    if (2LL * ((long long)out.size() + extra) <= V) {
+      for (int i = 0; i < extra; ++i) {
+        int s;
+        do s = (int)rng.below((uint32_t)V) + 1; while (test(s));
+        mark(s);
+        out.push_back(s);
+      }
+    } else {
+      missing.clear();
+      for (int s = 1; s <= V; ++s)
+        if (!test(s)) missing.push_back(s);
+      for (int i = 0; i < extra; ++i) {
+        swap(missing[i], missing[i + rng.below((uint32_t)(missing.size() - i))]);
+        out.push_back(missing[i]);
+      }
+    }
+    for (int s : out) marked[s >> 6] = 0;
+  }
+};
+
+static char* appendInt(char* p, int value) {
+  static const char pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+  char digits[12];
+  char* d = digits + sizeof(digits);
+  while (value >= 100) {
+    int pair = (value % 100) * 2;
+    value /= 100;
+    *--d = pairs[pair + 1];
+    *--d = pairs[pair];
+  }
+  if (value >= 10) {
+    *--d = pairs[value * 2 + 1];
+    *--d = pairs[value * 2];
+  } else {
+    *--d = (char)('0' + value);
+  }
+  size_t n = digits + sizeof(digits) - d;
+  memcpy(p, d, n);
+  return p + n;
+}
+
+// Same model as the default generator: V/L random stations per line, every
+// uncovered station joins a random line when bConnect, and lines grow with
+// random new stations until there are E edges. The header carries the number
+// of edges actually written.
+static void generateFast(int V, int E, int L, bool bConnect, int seed, int numThreads) {
+  const uint64_t saltBase = 1, saltExtra = 2, saltOrder = 3;
+  vector<vector<int> > lines(L);
+  int lineEdges = min(V, V / L);
+
+  parallelFor(L, numThreads, [&](int first, int last) {
+    StationSampler sampler(V);
+    for (int l = first; l < last; ++l) {
+      SplitMix64 rng = lineStream(seed, l + 1, saltBase);
+      lines[l].reserve(lineEdges);
+      sampler.extend(lines[l], lineEdges, rng);
+    }
+  });
+
+  SplitMix64 rng = lineStream(seed, 0, saltBase);
+  if (bConnect) {
+    vector<char> covered(V + 1, 0);
+    for (const vector<int>& stations : lines)
+      for (int s : stations) covered[s] = 1;
+    for (int s = 1; s <= V; ++s)
+      if (!covered[s]) lines[rng.below(L)].push_back(s);
+  }
+
+  // Spread the missing edges over the lines that still have room
+  long long currE = 0;
+  vector<int> open;
+  vector<int> extra(L, 0);
+  for (int l = 0; l < L; ++l) {
+    currE += max(0, (int)lines[l].size() - 1);
+    if ((int)lines[l].size() < V) open.push_back(l);
+  }
+  while (currE < E && !open.empty()) {
+    int pick = (int)rng.below((uint32_t)open.size());
+    int l = open[pick];
+    extra[l]++;
+    currE += lines[l].empty() && extra[l] == 1 ? 0 : 1;
+    if ((int)lines[l].size() + extra[l] == V) {
+      open[pick] = open.back();
+      open.pop_back();
+    }
+  }
+
+  parallelFor(L, numThreads, [&](int first, int last) {
+    StationSampler sampler(V);
+    for (int l = first; l < last; ++l) {
+      vector<int>& stations = lines[l];
+      if (extra[l]) {
+        SplitMix64 lineRng = lineStream(seed, l + 1, saltExtra);
+        sampler.extend(stations, extra[l], lineRng);
+      }
+      // linearly shuffle stations of line l
+      SplitMix64 orderRng = lineStream(seed, l + 1, saltOrder);
+      for (int i = (int)stations.size() - 1; i > 0; --i)
+        swap(stations[i], stations[orderRng.below((uint32_t)i + 1)]);
+    }
+  });
+
+  long long edges = 0;
+  for (const vector<int>& stations : lines)
+    edges += max(0, (int)stations.size() - 1);
+  printf("%d %lld %d\n", V, edges, L);
+
+  // Format blocks of lines in parallel and write them in order
+  const int blockLines = 64;
+  vector<vector<char> > text(blockLines);
+  for (int base = 0; base < L; base += blockLines) {
+    int count = min(blockLines, L - base);
+    parallelFor(count, numThreads, [&](int first, int last) {
+      for (int b = first; b < last; ++b) {
+        const vector<int>& stations = lines[base + b];
+        vector<char>& out = text[b];
+        out.resize(stations.size() * 36 + 1);
+        char* p = out.data();
+        for (size_t i = 1; i < stations.size(); ++i) {
+          p = appendInt(p, stations[i - 1]);
+          *p++ = ' ';
+          p = appendInt(p, stations[i]);
+          *p++ = ' ';
+          p = appendInt(p, base + b + 1);
+          *p++ = '\n';
+        }
+        out.resize(p - out.data());
+      }
+    });
+    for (int b = 0; b < count; ++b)
+      fwrite(text[b].data(), 1, text[b].size(), stdout);
+  }
+  fflush(stdout);
+}
+
 //-----------------------------------------------------------------------------
 int main(int argc, char* argv[]) {
     int V, E, L;
     bool bConnect = false;
     int seed = 0;
+    bool fast = false;
+    int numThreads = (int)thread::hardware_concurrency();
+
+    // Strip the options, leaving the positional arguments in argv
+    int positional = 1;
+    for (int i = 1; i < argc; ++i) {
+      if (strcmp(argv[i], "--fast") == 0) {
+        fast = true;
+      } else if (strncmp(argv[i], "--threads=", 10) == 0) {
+        numThreads = atoi(argv[i] + 10);
+      } else {
+        argv[positional++] = argv[i];
+      }
+    }
+    argc = positional;
+    if (numThreads < 1) numThreads = 1;
 
     if (argc < 4 || argc > 6) {
       cerr << "ERROR: Wrong number of arguments" << endl;
@@ -50,6 +268,14 @@ int main(int argc, char* argv[]) {
       cerr << "ERROR: E < V and bConnect" << endl;
       printUsage(argv[0]);
     }
+    if (L < 1 || V < 1) {
+      cerr << "ERROR: V and L must be positive" << endl;
+      printUsage(argv[0]);
+    }
+    if (fast) {
+      generateFast(V, E, L, bConnect, seed, numThreads);
+      return 0;
+    }
     cout << V << " " << E << " " << L << endl;
 
     //-------------------------------------------------------------------------
@@ -0,0 +1,408 @@
+#include <fstream>
+#include <vector>
+#include <cmath>
+#include <sstream>
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Benchmark driver for projeto2: generates a fixed-seed grid of inputs with
+// the gera.cpp generator, runs the solver several times on each with
+// --profile, and reports median/p95 phase times, peak memory, throughput
+// and the fitted scaling exponent of every phase in V, E and L. A run can
+// be saved as a baseline and later runs checked against it; the check
+// also compares the hardware cache misses the solver counted, when the
+// machine exposes them, so e.g. "-- --relabel=bfs" against a plain
+// baseline shows the miss reduction of relabeling.
+
+static const char* const phaseNames[] = {
+    "parse", "buildMetroGraph", "isolatedStationsExist", "checkContainedLines",
+    "systemBFS", "buildLinesGraph", "resultsBFS"
+};
+static const int numPhases = sizeof(phaseNames) / sizeof(phaseNames[0]);
+
+struct Settings {
+    std::string solver = "./projeto2";
+    std::string generator = "./gerador";
+    std::string workdir = "/tmp";
+    std::string grid = "full";
+    std::string save;
+    std::string check;
+    std::vector<std::string> solverArgs;
+    int runs = 5;
+    double threshold = 0.25; // allowed relative slowdown of a phase median
+    double minMs = 1.0; // phases faster than this in the baseline are not checked
+};
+
+struct GridPoint {
+    int V;
+    int E;
+    int L;
+    int seed;
+};
+
+struct PointResult {
+    GridPoint point;
+    double inputMB = 0;
+    long maxRssKB = 0;
+    double totalMedian = 0;
+    double missesMedian = -1; // -1 when the solver could not count them
+    double median[numPhases];
+    double p95[numPhases];
+};
+
+// The generator never terminates when E > L * (V - 1) (a line cannot hold
+// more stations), so every point keeps E well below that.
+static std::vector<GridPoint> buildGrid(const std::string& grid) {
+    std::vector<int> stations, ratios, lines;
+    if (grid == "small") {
+        stations = {1000, 4000};
+        ratios = {2, 4};
+        lines = {5, 20};
+    } else {
+        stations = {2000, 8000, 32000};
+        ratios = {2, 8};
+        lines = {10, 40, 160};
+    }
+    std::vector<GridPoint> points;
+    int seed = 1;
+    for (int V : stations) {
+        for (int ratio : ratios) {
+            for (int L : lines) {
+                points.push_back(GridPoint{V, V * ratio, L, seed++});
+            }
+        }
+    }
+    return points;
+}
+
+// Runs argv with stdout/stderr redirected to the given files (empty: /dev/null)
+// and returns the exit status; the child's peak RSS goes to maxRssKB.
+static int runProcess(const std::vector<std::string>& args, const std::string& stdoutPath,
+                      const std::string& stderrPath, long* maxRssKB) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        int out = open(stdoutPath.empty() ? "/dev/null" : stdoutPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = open(stderrPath.empty() ? "/dev/null" : stderrPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(out, 1);
+        dup2(err, 2);
+        std::vector<char*> argv;
+        for (const std::string& arg : args) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0) {
+        return -1;
+    }
+    if (maxRssKB) {
+#ifdef __APPLE__
+        *maxRssKB = usage.ru_maxrss / 1024;
+#else
+        *maxRssKB = usage.ru_maxrss;
+#endif
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream file(path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+// Value of "key":<number> in a flat JSON text, searching from position from.
+static bool jsonNumber(const std::string& json, const std::string& key, double& value, size_t from = 0) {
+    size_t at = json.find("\"" + key + "\":", from);
+    if (at == std::string::npos) {
+        return false;
+    }
+    value = std::strtod(json.c_str() + at + key.size() + 3, nullptr);
+    return true;
+}
+
+// Nearest-rank percentile of an unsorted sample.
+static double percentile(std::vector<double> sample, double fraction) {
+    std::sort(sample.begin(), sample.end());
+    size_t rank = (size_t)std::ceil(fraction * sample.size());
+    return sample[std::min(sample.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+static bool measurePoint(const Settings& settings, const GridPoint& point, PointResult& result) {
+    std::ostringstream name;
+    name << settings.workdir << "/bench_" << point.V << "_" << point.E << "_" << point.L << "_" << point.seed;
+    std::string inputPath = name.str() + ".in";
+    std::string profilePath = name.str() + ".profile";
+    struct stat st;
+    if (stat(inputPath.c_str(), &st) != 0) {
+        std::vector<std::string> generate = {settings.generator, std::to_string(point.V), std::to_string(point.E),
+                                             std::to_string(point.L), "1", std::to_string(point.seed)};
+        if (runProcess(generate, inputPath, "", nullptr) != 0 || stat(inputPath.c_str(), &st) != 0) {
+            std::cerr << "Could not generate " << inputPath << "\n";
+            return false;
+        }
+    }
+    result.point = point;
+    result.inputMB = st.st_size / 1e6;
+
+    std::vector<std::string> solve = {settings.solver, "--profile"};
+    solve.insert(solve.end(), settings.solverArgs.begin(), settings.solverArgs.end());
+    solve.push_back(inputPath);
+    std::vector<std::vector<double>> samples(numPhases + 1);
+    std::vector<double> misses;
+    for (int run = 0; run < settings.runs; run++) {
+        long rss = 0;
+        if (runProcess(solve, "", profilePath, &rss) != 0) {
+            std::cerr << "Solver failed on " << inputPath << "\n";
+            return false;
+        }
+        result.maxRssKB = std::max(result.maxRssKB, rss);
+        std::string profile = readFile(profilePath);
+        size_t phases = profile.find("\"phases_ms\"");
+        double total = 0;
+        for (int phase = 0; phase < numPhases; phase++) {
+            double ms = 0;
+            jsonNumber(profile, phaseNames[phase], ms, phases);
+            samples[phase].push_back(ms);
+            total += ms;
+        }
+        samples[numPhases].push_back(total);
+        double count = -1;
+        jsonNumber(profile, "cache_misses", count);
+        misses.push_back(count);
+    }
+    for (int phase = 0; phase < numPhases; phase++) {
+        result.median[phase] = percentile(samples[phase], 0.5);
+        result.p95[phase] = percentile(samples[phase], 0.95);
+    }
+    result.totalMedian = percentile(samples[numPhases], 0.5);
+    result.missesMedian = percentile(misses, 0.5);
+    std::remove(profilePath.c_str());
+    return true;
+}
+
+// Least squares fit of log(ms) = c + a log V + b log E + g log L over the
+// points where the phase took measurable time. Returns false when the grid
+// does not determine the exponents.
+static bool fitExponents(const std::vector<PointResult>& results, int phase, double exponents[3]) {
+    double normal[4][5] = {{0}};
+    int used = 0;
+    for (const PointResult& result : results) {
+        if (result.median[phase] < 0.05) {
+            continue;
+        }
+        double x[4] = {1, std::log((double)result.point.V), std::log((double)result.point.E),
+                       std::log((double)result.point.L)};
+        double y = std::log(result.median[phase]);
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                normal[i][j] += x[i] * x[j];
+            }
+            normal[i][4] += x[i] * y;
+        }
+        used++;
+    }
+    if (used < 5) {
+        return false;
+    }
+    for (int col = 0; col < 4; col++) {
+        int pivot = col;
+        for (int row = col + 1; row < 4; row++) {
+            if (std::fabs(normal[row][col]) > std::fabs(normal[pivot][col])) {
+                pivot = row;
+            }
+        }
+        if (std::fabs(normal[pivot][col]) < 1e-9) {
+            return false;
+        }
+        std::swap(normal[col], normal[pivot]);
+        for (int row = 0; row < 4; row++) {
+            if (row != col) {
+                double factor = normal[row][col] / normal[col][col];
+                for (int k = col; k < 5; k++) {
+                    normal[row][k] -= factor * normal[col][k];
+                }
+            }
+        }
+    }
+    for (int k = 0; k < 3; k++) {
+        exponents[k] = normal[k + 1][4] / normal[k + 1][k + 1];
+    }
+    return true;
+}
+
+static std::string pointId(const GridPoint& point) {
+    std::ostringstream id;
+    id << point.V << "-" << point.E << "-" << point.L << "-" << point.seed;
+    return id.str();
+}
+
+// One point per line so a baseline can be looked up by its id.
+static void writeBaseline(const std::string& path, const std::vector<PointResult>& results) {
+    std::ofstream out(path);
+    out << "{\"points\":[\n";
+    for (size_t k = 0; k < results.size(); k++) {
+        const PointResult& result = results[k];
+        out << "{\"id\":\"" << pointId(result.point) << "\",\"V\":" << result.point.V << ",\"E\":" << result.point.E
+            << ",\"L\":" << result.point.L << ",\"maxRssKB\":" << result.maxRssKB
+            << ",\"totalMedian\":" << result.totalMedian << ",\"cacheMisses\":" << result.missesMedian;
+        for (int phase = 0; phase < numPhases; phase++) {
+            out << ",\"" << phaseNames[phase] << "\":{\"median\":" << result.median[phase]
+                << ",\"p95\":" << result.p95[phase] << "}";
+        }
+        out << "}" << (k + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "]}\n";
+}
+
+// Returns the number of phase medians slower than the baseline allows.
+static int checkBaseline(const Settings& settings, const std::vector<PointResult>& results) {
+    std::string baseline = readFile(settings.check);
+    if (baseline.empty()) {
+        std::cerr << "Could not read baseline " << settings.check << "\n";
+        return 1;
+    }
+    int regressions = 0;
+    for (const PointResult& result : results) {
+        size_t at = baseline.find("\"id\":\"" + pointId(result.point) + "\"");
+        if (at == std::string::npos) {
+            std::cout << "  " << pointId(result.point) << ": not in baseline\n";
+            continue;
+        }
+        size_t lineEnd = baseline.find('\n', at);
+        std::string entry = baseline.substr(at, lineEnd - at);
+        double referenceMisses = -1;
+        if (jsonNumber(entry, "cacheMisses", referenceMisses) && referenceMisses > 0 && result.missesMedian >= 0) {
+            std::cout << "  " << pointId(result.point) << " cache misses: " << result.missesMedian / 1e6 << "M vs "
+                      << referenceMisses / 1e6 << "M (x" << result.missesMedian / referenceMisses << ")\n";
+        }
+        for (int phase = 0; phase < numPhases; phase++) {
+            double reference = 0;
+            if (!jsonNumber(entry, std::string(phaseNames[phase]) + "\":{\"median", reference)
+                || reference < settings.minMs) {
+                continue;
+            }
+            double ratio = result.median[phase] / reference;
+            if (ratio > 1 + settings.threshold) {
+                std::cout << "  REGRESSION " << pointId(result.point) << " " << phaseNames[phase] << ": "
+                          << result.median[phase] << " ms vs " << reference << " ms (x" << ratio << ")\n";
+                regressions++;
+            }
+        }
+    }
+    return regressions;
+}
+
+static void printUsage(const char* progname) {
+    std::cerr << "Usage: " << progname << " [--runs=N] [--grid=small|full] [--solver=PATH] [--generator=PATH]\n"
+              << "       [--workdir=DIR] [--save=baseline.json] [--check=baseline.json] [--threshold=0.25]\n"
+              << "       [--min-ms=1] [-- solver options...]\n";
+}
+
+int main(int argc, char* argv[]) {
+    Settings settings;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        size_t eq = arg.find('=');
+        std::string value = eq == std::string::npos ? "" : arg.substr(eq + 1);
+        if (arg == "--") {
+            settings.solverArgs.assign(argv + i + 1, argv + argc);
+            break;
+        } else if (arg.compare(0, 7, "--runs=") == 0) {
+            settings.runs = std::max(1, std::atoi(value.c_str()));
+        } else if (arg.compare(0, 7, "--grid=") == 0) {
+            settings.grid = value;
+        } else if (arg.compare(0, 9, "--solver=") == 0) {
+            settings.solver = value;
+        } else if (arg.compare(0, 12, "--generator=") == 0) {
+            settings.generator = value;
+        } else if (arg.compare(0, 10, "--workdir=") == 0) {
+            settings.workdir = value;
+        } else if (arg.compare(0, 7, "--save=") == 0) {
+            settings.save = value;
+        } else if (arg.compare(0, 8, "--check=") == 0) {
+            settings.check = value;
+        } else if (arg.compare(0, 12, "--threshold=") == 0) {
+            settings.threshold = std::atof(value.c_str());
+        } else if (arg.compare(0, 9, "--min-ms=") == 0) {
+            settings.minMs = std::atof(value.c_str());
+        } else {
+            printUsage(argv[0]);
+            return 2;
+        }
+    }
+
+    // Baselines are per machine and not in the repository, so a missing
+    // one fails before the grid runs instead of after it.
+    if (!settings.check.empty() && readFile(settings.check).empty()) {
+        std::cerr << "No baseline at " << settings.check
+                  << "; record one on this machine first with make bench-baseline (or --save=)\n";
+        return 2;
+    }
+
+    std::vector<PointResult> results;
+    std::cout << "V\tE\tL\tMB\tRSS(MB)\tMB/s\ttotal(ms)\tmisses(M)";
+    for (int phase = 0; phase < numPhases; phase++) {
+        std::cout << "\t" << phaseNames[phase] << "(med/p95)";
+    }
+    std::cout << "\n";
+    for (const GridPoint& point : buildGrid(settings.grid)) {
+        PointResult result;
+        if (!measurePoint(settings, point, result)) {
+            return 2;
+        }
+        results.push_back(result);
+        std::cout << point.V << "\t" << point.E << "\t" << point.L << "\t" << result.inputMB << "\t"
+                  << result.maxRssKB / 1024.0 << "\t"
+                  << (result.totalMedian > 0 ? result.inputMB / (result.totalMedian / 1000) : 0) << "\t"
+                  << result.totalMedian << "\t";
+        if (result.missesMedian >= 0) {
+            std::cout << result.missesMedian / 1e6;
+        } else {
+            std::cout << "n/a";
+        }
+        for (int phase = 0; phase < numPhases; phase++) {
+            std::cout << "\t" << result.median[phase] << "/" << result.p95[phase];
+        }
+        std::cout << std::endl;
+    }
+
+    std::cout << "\nScaling exponents (time ~ V^a E^b L^c):\n";
+    for (int phase = 0; phase < numPhases; phase++) {
+        double exponents[3];
+        std::cout << "  " << phaseNames[phase] << ": ";
+        if (fitExponents(results, phase, exponents)) {
+            std::cout << "a=" << exponents[0] << " b=" << exponents[1] << " c=" << exponents[2] << "\n";
+        } else {
+            std::cout << "not enough measurable points\n";
+        }
+    }
+
+    if (!settings.save.empty()) {
+        writeBaseline(settings.save, results);
+        std::cout << "\nBaseline written to " << settings.save << "\n";
+    }
+    if (!settings.check.empty()) {
+        std::cout << "\nChecking against " << settings.check << " (threshold " << settings.threshold * 100 << "%):\n";
+        int regressions = checkBaseline(settings, results);
+        if (regressions) {
+            std::cout << regressions << " phase(s) regressed\n";
+            return 1;
+        }
+        std::cout << "No regressions\n";
+    }
+    return 0;
+}
@@ -1,7 +1,7 @@
 #!/bin/bash
 
 # Compile the necessary programs
-g++ -std=c++11 -O3 -Wall gera.cpp -lm -g -o gerador
+g++ -std=c++11 -O3 -Wall -pthread gera.cpp -lm -g -o gerador
 g++ -std=c++11 -O3 -Wall linear_regression.cpp -lm -g -o linear_regression
 # Navigate to the project directory
 
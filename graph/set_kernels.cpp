@@ -0,0 +1,164 @@
+// Microbenchmark of the sorted set kernels in projeto2.cpp against the
+// unordered_set::find loop they replace. For each pair shape it times
+// the intersection test, the intersection size and the subset test with
+// every kernel the CPU supports, with sortedSetScan() (which also
+// gallops on skewed pairs) and with hash lookups, after checking that
+// all of them agree with std::set_intersection.
+#define PROJETO2_NO_MAIN
+#include "../projeto2.cpp"
+
+#include <random>
+
+struct PairShape {
+    const char* name;
+    int smallSize;
+    int largeSize;
+    int universe;
+    bool nested; // the small set is drawn from the large one
+};
+
+struct SetPair {
+    std::vector<int> small;
+    std::vector<int> large;
+    std::unordered_set<int> smallSet;
+    std::unordered_set<int> largeSet;
+};
+
+static std::vector<int> sortedSample(std::mt19937& rng, int count, const std::vector<int>& from){
+    std::vector<int> pool = from;
+    for (int k = 0; k < count; k++){
+        std::swap(pool[k], pool[k + rng() % (pool.size() - k)]);
+    }
+    pool.resize(count);
+    std::sort(pool.begin(), pool.end());
+    return pool;
+}
+
+static std::vector<SetPair> buildPairs(const PairShape& shape, int numPairs, unsigned seed){
+    std::mt19937 rng(seed);
+    std::vector<int> universe(shape.universe);
+    std::iota(universe.begin(), universe.end(), 1);
+    std::vector<SetPair> pairs(numPairs);
+    for (SetPair& pair : pairs){
+        pair.large = sortedSample(rng, shape.largeSize, universe);
+        pair.small = sortedSample(rng, shape.smallSize, shape.nested ? pair.large : universe);
+        pair.smallSet.insert(pair.small.begin(), pair.small.end());
+        pair.largeSet.insert(pair.large.begin(), pair.large.end());
+    }
+    return pairs;
+}
+
+static size_t hashScan(const SetPair& pair, SetOp op){
+    size_t count = 0;
+    for (int station : pair.smallSet){
+        if (pair.largeSet.find(station) == pair.largeSet.end()){
+            if (op == SetOp::Subset){
+                return 0;
+            }
+        } else {
+            if (op == SetOp::Intersects){
+                return 1;
+            }
+            count++;
+        }
+    }
+    return op == SetOp::Subset ? 1 : count;
+}
+
+static size_t expected(const SetPair& pair, SetOp op){
+    std::vector<int> common;
+    std::set_intersection(pair.small.begin(), pair.small.end(), pair.large.begin(), pair.large.end(),
+                          std::back_inserter(common));
+    if (op == SetOp::Intersects){
+        return !common.empty();
+    }
+    if (op == SetOp::Subset){
+        return common.size() == pair.small.size();
+    }
+    return common.size();
+}
+
+// Results of the timed scans end up here so the loops cannot be dropped.
+static volatile size_t sink;
+
+// Average nanoseconds per call of scan over all pairs, repeated until at
+// least minSeconds have passed.
+template <typename Scan>
+static double timeScan(const std::vector<SetPair>& pairs, double minSeconds, const Scan& scan){
+    long long calls = 0;
+    size_t checksum = 0;
+    auto start = std::chrono::steady_clock::now();
+    double elapsed = 0;
+    do {
+        for (const SetPair& pair : pairs){
+            checksum += scan(pair);
+        }
+        calls += pairs.size();
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    sink = checksum;
+    return elapsed * 1e9 / calls;
+}
+
+int main(int argc, char* argv[]){
+    double minSeconds = 0.2;
+    for (int i = 1; i < argc; i++){
+        if (std::strncmp(argv[i], "--min-time=", 11) == 0){
+            minSeconds = std::atof(argv[i] + 11);
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--min-time=seconds]\n";
+            return 1;
+        }
+    }
+
+    const PairShape shapes[] = {
+        {"equal-64", 64, 64, 1024, false},
+        {"equal-1k", 1000, 1000, 16000, false},
+        {"equal-16k", 16000, 16000, 200000, false},
+        {"nested-1k", 1000, 4000, 16000, true},
+        {"nested-16k", 16000, 32000, 200000, true},
+        {"skewed-16/16k", 16, 16000, 200000, false},
+        {"skewed-nested", 16, 16000, 200000, true},
+    };
+    const SetOp ops[] = {SetOp::Intersects, SetOp::Count, SetOp::Subset};
+    const char* const opNames[] = {"intersects", "count", "subset"};
+    std::vector<SetKernel> kernels = supportedSetKernels();
+
+    std::cout << "shape            op          hash";
+    for (const SetKernel& kernel : kernels){
+        std::cout << "  " << std::string(9 - std::strlen(kernel.name), ' ') << kernel.name;
+    }
+    std::cout << "   dispatch   (ns per call)\n";
+
+    for (const PairShape& shape : shapes){
+        int numPairs = std::max(4, 200000 / (shape.smallSize + shape.largeSize));
+        std::vector<SetPair> pairs = buildPairs(shape, numPairs, 7);
+        for (int k = 0; k < 3; k++){
+            SetOp op = ops[k];
+            for (const SetPair& pair : pairs){
+                size_t want = expected(pair, op);
+                bool ok = hashScan(pair, op) == want
+                    && sortedSetScan(pair.small.data(), pair.small.size(), pair.large.data(), pair.large.size(), op) == want;
+                for (const SetKernel& kernel : kernels){
+                    ok = ok && kernel.scan(pair.small.data(), pair.small.size(),
+                                           pair.large.data(), pair.large.size(), op) == want;
+                }
+                if (!ok){
+                    std::cerr << "Mismatch on " << shape.name << " " << opNames[k] << "\n";
+                    return 1;
+                }
+            }
+            std::printf("%-16s %-10s %6.0f", shape.name, opNames[k],
+                        timeScan(pairs, minSeconds, [&](const SetPair& pair){ return hashScan(pair, op); }));
+            for (const SetKernel& kernel : kernels){
+                std::printf("  %9.0f", timeScan(pairs, minSeconds, [&](const SetPair& pair){
+                    return kernel.scan(pair.small.data(), pair.small.size(), pair.large.data(), pair.large.size(), op);
+                }));
+            }
+            std::printf("  %9.0f\n", timeScan(pairs, minSeconds, [&](const SetPair& pair){
+                return sortedSetScan(pair.small.data(), pair.small.size(), pair.large.data(), pair.large.size(), op);
+            }));
+        }
+    }
+    return 0;
+}
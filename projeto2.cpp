@@ -4,235 +4,4263 @@
 #include <queue>
 #include <unordered_map>
 #include <algorithm>
+#include <numeric>
 #include <set>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include <limits>
+#include <cstdlib>
+#include <cstdint>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
-struct Graphs {
-    std::vector<std::unordered_set<int>> metroGraph; // represents the full metro system
-    std::vector<std::unordered_set<int>> linesGraph; // represents the full metro system
-    std::vector<std::unordered_set<int>> linesByStation;
-    std::vector<std::unordered_set<int>> stationsByLine;
-    std::vector<bool> lineContainedInAnotherLine;
+// Storage used for the adjacency of every graph in Graphs.
+// Sets keeps the original hash set containers, Csr packs every row into
+// contiguous offset/target arrays.
+enum class GraphLayout { Sets, Csr };
+
+// Algorithm used by resultsBFS() for the line graph diameter.
+// Bfs runs one search per line, Bitset advances 256 sources at once,
+// Bounds only searches from lines whose eccentricity bounds still matter.
+enum class DiameterEngine { Bfs, Bitset, Bounds };
+
+// Labels precomputed by --query for station to station transfers.
+// Matrix keeps every line-to-line distance, Landmarks a pruned landmark
+// labeling; Auto takes the matrix up to 4096 lines.
+enum class TransferLabels { Auto, Matrix, Landmarks };
+
+// Renumbering of stations and lines before solving (CSR layout). Bfs
+// numbers them in the order a breadth-first search of the station-line
+// membership graph meets them, Degree by decreasing degree.
+enum class Relabeling { None, Bfs, Degree };
+
+// Reduction of the line graph before resultsBFS() (CSR layout). Twins
+// merges lines with the same neighbours into one representative.
+enum class LineReduction { None, Twins };
+
+struct SolverOptions {
+    GraphLayout layout = GraphLayout::Csr;
+    std::vector<const char*> inputPaths; // stdin when empty
+    bool batch = false; // inputs hold concatenated instances
+    int numJobs = 1; // instances solved in parallel in batch mode
+    bool serve = false; // apply add/remove/query commands from stdin
+    bool query = false; // answer station to station transfer queries from stdin
+    TransferLabels labels = TransferLabels::Auto;
+    const char* convertPath = nullptr; // write the input as a binary graph here and exit
+    const char* eccentricitiesPath = nullptr; // per-line eccentricities (single instance only)
+    const char* distancesPath = nullptr; // line-to-line distance matrix (single instance only)
+    bool binaryDistances = false; // int32 records instead of CSV for the two above
+    bool stats = false;
+    bool lean = false; // parse twice instead of keeping the connections (CSR layout only)
+    bool profile = false; // one JSON line of phase times per instance on stderr
+    int numThreads = 0; // 0 uses every hardware thread
+    DiameterEngine engine = DiameterEngine::Bfs;
+    Relabeling relabel = Relabeling::None;
+    LineReduction reduce = LineReduction::Twins;
+    bool approximate = false; // bound the answer with a few searches instead of solving it
+    int sweeps = 16; // --approximate: line graph searches allowed, 0 for no limit
+    int budgetMs = 0; // --approximate: stop searching this long after the solve started, 0 for no limit
+    int memoryMb = 0; // external-memory solver with this much buffer space when > 0
+    const char* tempDir = nullptr; // its spill files ($TMPDIR or /tmp when null)
 };
 
-class Information {
-private:
-    int numConnections;
-    int numStations;
-    int numLines;
-    int solution;
-    Graphs graphs;
+// Solver phases timed for --profile and --stats.
+enum Phase {
+    PhaseParse, PhaseBuildMetroGraph, PhaseIsolatedStations, PhaseContainedLines,
+    PhaseSystemBFS, PhaseLinesGraph, PhaseResultsBFS, NumPhases
+};
 
-public:
-    Information(int numStations, int numConnections, int numLines);
-    void addAdj(int u, int v, int line);
-    void buildMetroGraph();
-    bool isolatedStationsExist();
-    bool systemBFS();
-    void checkContainedLines();
-    int resultsBFS();
+static const char* const phaseNames[NumPhases] = {
+    "parse", "buildMetroGraph", "isolatedStationsExist", "checkContainedLines",
+    "systemBFS", "buildLinesGraph", "resultsBFS"
+};
 
-    //Debugging
-    void printLinesGraph();
-    void printMetroGraph();
-    void printLinesByStation();
+// Per-instance instrumentation. Phase times are always recorded (a clock
+// read per phase); the work counters only exist when built with
+// -DPROFILE_COUNTERS, otherwise PROFILE_COUNT() compiles to nothing and
+// the hot loops are untouched. Worker threads count locally and add
+// their totals once.
+struct Profile {
+    double seconds[NumPhases];
+    std::atomic<long long> edgesScanned;
+    std::atomic<long long> nodesExpanded;
+    std::atomic<long long> subsetTests;
+    std::atomic<long long> bfsRuns; // line graph searches, one per source; always counted
+    long long cacheMisses; // hardware cache misses under --profile, -1 when not counted
+    int lineGraphLines; // lines in the line graph before and after mergeTwinLines(), -1 if not run
+    int reducedLines;
+    long long spilledBytes; // written to temporary runs by the external-memory solver
+    int spilledRuns;
 
-    int getSolution() const;
+    Profile() { reset(); }
+
+    void reset(){
+        std::fill(seconds, seconds + NumPhases, 0.0);
+        edgesScanned = 0;
+        nodesExpanded = 0;
+        subsetTests = 0;
+        bfsRuns = 0;
+        cacheMisses = -1;
+        lineGraphLines = -1;
+        reducedLines = -1;
+        spilledBytes = 0;
+        spilledRuns = 0;
+    }
 };
 
-Information::Information(int numStations, int numConnections, int numLines)
-    : numConnections(numConnections), numStations(numStations), numLines(numLines) {
-        if (numStations == 1){
-            solution = 0;
+#ifdef PROFILE_COUNTERS
+#define PROFILE_COUNT(statement) statement
+#else
+#define PROFILE_COUNT(statement)
+#endif
+
+// Adds the lifetime of the timer to one phase of a Profile.
+class PhaseTimer {
+private:
+    Profile& profile;
+    Phase phase;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    PhaseTimer(Profile& profile, Phase phase)
+        : profile(profile), phase(phase), start(std::chrono::steady_clock::now()) {}
+    ~PhaseTimer(){
+        profile.seconds[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+// Counts the hardware cache misses of its lifetime into
+// profile.cacheMisses, threads started meanwhile included. The count
+// stays -1 where the counter cannot be opened: off Linux, under a strict
+// perf_event_paranoid, or without a PMU (most virtual machines).
+class CacheMissCounter {
+private:
+    Profile& profile;
+    int fd = -1;
+
+public:
+    CacheMissCounter(Profile& profile, bool enabled) : profile(profile) {
+#ifdef __linux__
+        if (!enabled){
             return;
         }
-        graphs.metroGraph.resize(numStations + 1);
-        graphs.linesGraph.resize(numLines + 1);
-        graphs.linesByStation.resize(numStations + 1);
-        graphs.stationsByLine.resize(numLines + 1);
-        graphs.lineContainedInAnotherLine.resize(numLines + 1, false);
-        buildMetroGraph();
-        //printMetroGraph();
-        if (isolatedStationsExist()){
-            solution = -1;
-            return;
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd >= 0){
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
         }
-        checkContainedLines();
-        if (!systemBFS()){
-            solution = -1;
+#else
+        (void)enabled;
+#endif
+    }
+    ~CacheMissCounter(){
+        if (fd < 0){
             return;
         }
-        //printLinesGraph();
-        solution = resultsBFS();
-        return;
+        long long count = 0;
+        if (read(fd, &count, sizeof(count)) == sizeof(count)){
+            profile.cacheMisses = count;
+        }
+        close(fd);
+    }
+};
 
+static int resolveThreads(int requested){
+    if (requested > 0){
+        return requested;
+    }
+    int hardware = std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
 }
 
-int Information::getSolution() const{
-    return solution;
+// Runs work(threadIndex) on numThreads threads, the calling thread being
+// index 0, and waits for all of them.
+static void runWorkers(int numThreads, const std::function<void(int)>& work){
+    std::vector<std::thread> threads;
+    for (int t = 1; t < numThreads; t++){
+        threads.emplace_back(work, t);
+    }
+    work(0);
+    for (std::thread& thread : threads){
+        thread.join();
+    }
 }
 
-void Information::addAdj(int u, int v, int line) {
-    graphs.metroGraph[u].insert(v);
-    graphs.metroGraph[v].insert(u);
+#ifdef COUNT_ALLOCATIONS
+// Build with -DCOUNT_ALLOCATIONS to count every heap allocation of the
+// process; --stats then reports the total.
+static std::atomic<long long> heapAllocations(0);
+
+__attribute__((noinline)) void* operator new(size_t size){
+    heapAllocations++;
+    void* p = std::malloc(size ? size : 1);
+    if (!p){
+        throw std::bad_alloc();
+    }
+    return p;
 }
 
-void Information::printLinesByStation(){
-    for (int i = 1; i <= numStations; i++){
-        std::cout << "Station " << i << " is in lines: ";
-        for (int line : graphs.linesByStation[i]){
-            std::cout << line << " ";
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    std::free(p);
+}
+#endif
+
+// Monotonic arena: allocations bump an offset inside the current block
+// and are only released all together by reset() or the destructor. When
+// sized from the instance header a whole solve fits in one block, so it
+// costs a single malloc. allocate() may be called from worker threads.
+class Arena {
+private:
+    std::vector<char*> blocks;
+    char* current = nullptr;
+    size_t used = 0;
+    size_t capacity = 0;
+    size_t bytesInUse = 0;
+    size_t peakBytes = 0;
+    long long mallocs = 0;
+    std::mutex mutex;
+
+    void releaseBlocks(){
+        for (char* block : blocks){
+            std::free(block);
         }
-        std::cout << "\n";
+        blocks.clear();
+        current = nullptr;
+        used = capacity = 0;
     }
-}
 
-void Information::buildMetroGraph() {
-    int u, v, line;
-    //printMetroGraph();
-    for (int i = 0; i < numConnections; i++) {
-        std::cin >> u >> v >> line;
-        //std::cout << "\nU: " << u << " V: " << v << " Line: " << line << "\n";
-        addAdj(u, v, line);
-        graphs.linesByStation[u].insert(line);
-        graphs.linesByStation[v].insert(line);
-        graphs.stationsByLine[line].insert(u);
-        graphs.stationsByLine[line].insert(v);
-        //printMetroGraph();
+    void addBlock(size_t bytes){
+        current = static_cast<char*>(std::malloc(bytes));
+        if (!current){
+            throw std::bad_alloc();
+        }
+        blocks.push_back(current);
+        used = 0;
+        capacity = bytes;
+        mallocs++;
     }
-}
 
+public:
+    Arena() {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    ~Arena() { releaseBlocks(); }
 
-void Information::printMetroGraph() {
-    std::cout << "Graph representation:\n";
-    for (int station = 1; station <= numStations; ++station) {
-        std::cout << "Station " << station << " is connected to stations: ";
-        for (int station : graphs.metroGraph[station]) {
-            std::cout << station << " ";
+    // Forgets every allocation and makes room for expectedBytes in one
+    // block, keeping the current block when it is big enough.
+    void reset(size_t expectedBytes){
+        if (blocks.size() != 1 || capacity < expectedBytes){
+            releaseBlocks();
+            addBlock(std::max<size_t>(expectedBytes, 1 << 16));
         }
-        std::cout << "\n";
+        used = 0;
+        bytesInUse = 0;
+        peakBytes = 0;
     }
-}
 
-void Information::printLinesGraph() {
-    std::cout << "Lines graph representation:\n";
-    for (int line = 1; line <= numLines; ++line) {
-        std::cout << "Line " << line << " connects to lines: ";
-        for (const auto& station : graphs.linesGraph[line]) {
-            std::cout << station << " ";
+    void* allocate(size_t bytes, size_t alignment){
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t start = (used + alignment - 1) & ~(alignment - 1);
+        if (!current || start + bytes > capacity){
+            addBlock(std::max(bytes + alignment, capacity * 2));
+            start = (used + alignment - 1) & ~(alignment - 1);
         }
-        std::cout << "\n";
+        bytesInUse += start + bytes - used;
+        peakBytes = std::max(peakBytes, bytesInUse);
+        used = start + bytes;
+        return current + start;
     }
-}
 
-bool Information::isolatedStationsExist() {
-    for (int station = 1; station <= numStations; station++) {
-        if (graphs.metroGraph[station].empty()) {
-            return true;
+    long long getMallocs() const { return mallocs; }
+    size_t getPeakBytes() const { return peakBytes; }
+    size_t getCapacity() const { return capacity; }
+};
+
+// Allocator drawing from an Arena; with no arena it uses the heap.
+// Deallocation is a no-op on arena memory.
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    Arena* arena;
+
+    ArenaAllocator(Arena* arena = nullptr) noexcept : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : arena(other.arena) {}
+
+    T* allocate(size_t n){
+        if (!arena){
+            return static_cast<T*>(::operator new(n * sizeof(T)));
         }
+        return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
     }
-    return false;
+
+    void deallocate(T* p, size_t){
+        if (!arena){
+            ::operator delete(p);
+        }
+    }
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b){
+    return a.arena == b.arena;
 }
 
-bool Information::systemBFS(){
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b){
+    return a.arena != b.arena;
+}
 
-    //printLinesByStation();
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
 
-    std::vector<int> visited(numStations + 1, 0);
-    std::queue<int> q;
-    q.push(1);
-    visited[1] = 1;
-    while (!q.empty()){
-        int station = q.front();
-        q.pop();
-        for (int line1 : graphs.linesByStation[station]){
-            for (int line2 : graphs.linesByStation[station]){
-                if (line1 != line2 && !graphs.lineContainedInAnotherLine[line1] && !graphs.lineContainedInAnotherLine[line2]){
-                    graphs.linesGraph[line1].insert(line2);
-                    graphs.linesGraph[line2].insert(line1);
-                }
+// Position inside an InputReader's data. The data always ends in a
+// non-digit sentinel so the digit loop needs no bounds check.
+struct InputCursor {
+    const char* pos;
+    const char* end;
+    bool mapped; // the input is a file mapping, see releaseBefore()
+
+    // Reads the next non-negative integer, skipping any separators.
+    bool nextInt(int& value) {
+        const char* p = pos;
+        while ((unsigned)(*p - '0') > 9) {
+            if (p == end) {
+                pos = p;
+                return false;
             }
+            p++;
+        }
+        unsigned x = *p++ - '0';
+        unsigned digit;
+        while ((digit = (unsigned)(*p - '0')) <= 9) {
+            x = x * 10 + digit;
+            p++;
+        }
+        pos = p;
+        value = (int)x;
+        return true;
+    }
+
+    // Drops the mapped pages in [from, pos) from memory; they are read
+    // back from the file if touched again. No-op on read() input.
+    void releaseBefore(const char* from) const {
+        if (!mapped) {
+            return;
+        }
+        uintptr_t pageMask = ~(uintptr_t)(sysconf(_SC_PAGESIZE) - 1);
+        uintptr_t first = (uintptr_t)from & pageMask;
+        uintptr_t last = (uintptr_t)pos & pageMask;
+        if (last > first) {
+            madvise((void*)first, last - first, MADV_DONTNEED);
         }
-        for (int adjStation : graphs.metroGraph[station]){
-            if (!visited[adjStation]){
-                visited[adjStation] = 1;
-                q.push(adjStation);
+    }
+
+    // Skips count integers; false if the input ends first.
+    bool skipInts(long long count) {
+        int ignored;
+        for (long long k = 0; k < count; k++) {
+            if (!nextInt(ignored)) {
+                return false;
             }
         }
+        return true;
     }
-    for (int i = 1; i <= numStations; i++){
-        if (!visited[i]){
+};
+
+// Whole-input reader. Regular files are mmapped, pipes and ttys are
+// slurped with large read() calls.
+class InputReader {
+private:
+    const char* data = nullptr;
+    const char* end = nullptr;
+    size_t mappedSize = 0;
+    std::vector<char> buffer;
+
+    bool readAll(int fd);
+
+public:
+    InputReader() {}
+    InputReader(const InputReader&) = delete;
+    InputReader& operator=(const InputReader&) = delete;
+    ~InputReader();
+
+    bool open(const char* path, bool populate = true);
+
+    InputCursor cursor(size_t offset = 0) const { return InputCursor{data + offset, end, mappedSize != 0}; }
+    size_t offsetOf(const InputCursor& cursor) const { return cursor.pos - data; }
+    const char* bytes() const { return data; }
+    size_t size() const { return end - data; }
+};
+
+InputReader::~InputReader() {
+    if (mappedSize) {
+        munmap((void*)data, mappedSize);
+    }
+}
+
+// populate maps the whole file in up front; --lean leaves it off so only
+// the pages being parsed are resident.
+bool InputReader::open(const char* path, bool populate) {
+    int fd = 0;
+    if (path) {
+        fd = ::open(path, O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+    }
+    struct stat st;
+    long pageSize = sysconf(_SC_PAGESIZE);
+    // A file whose size is a multiple of the page size has no zero padding
+    // after it to act as sentinel, so it goes through read() as well.
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size % pageSize != 0) {
+        int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+        if (populate) {
+            flags |= MAP_POPULATE;
+        }
+#endif
+        void* mapped = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+        if (mapped != MAP_FAILED) {
+            madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+            mappedSize = st.st_size;
+            data = (const char*)mapped;
+            end = data + st.st_size;
+            if (path) {
+                close(fd);
+            }
+            return true;
+        }
+    }
+    bool ok = readAll(fd);
+    if (path) {
+        close(fd);
+    }
+    return ok;
+}
+
+bool InputReader::readAll(int fd) {
+    const size_t chunk = 1 << 22;
+    size_t used = 0;
+    for (;;) {
+        buffer.resize(used + chunk + 1);
+        ssize_t got = read(fd, buffer.data() + used, chunk);
+        if (got < 0) {
             return false;
         }
+        if (got == 0) {
+            break;
+        }
+        used += got;
     }
+    buffer.resize(used + 1);
+    buffer[used] = '\0';
+    data = buffer.data();
+    end = data + used;
     return true;
 }
 
+struct Connection {
+    int u;
+    int v;
+    int line;
+};
 
-int Information::resultsBFS(){
-    int solution = 0;
-    for (int i = 1; i <= numLines; i++){
-        std::vector<int> visited(numLines + 1, 0);
-        std::vector<int> distances(numLines + 1, 0);
-        std::queue<int> q;
-        q.push(i);
-        visited[i] = 1;
-        distances[i] = 0;
-        int maxDistance;
-        maxDistance = 0;
-        while (!q.empty()){
-            int line = q.front();
-            q.pop();
-            for (int adjLine : graphs.linesGraph[line]){
-                //std::cout << "Line: "<< line << "\n";
-                if (!visited[adjLine]){
-                    //std::cout << "AdjLine: "<< adjLine << "\n";
-                    visited[adjLine] = 1;
-                    distances[adjLine] = distances[line] + 1;
-                    //std::cout << "Distance: "<< distances[adjLine] << "\n" << "\n";
-                    maxDistance = std::max(maxDistance, distances[adjLine]);
-                    q.push(adjLine);
+// A row of a CsrAdjacency, iterable like the unordered_set rows.
+struct CsrRow {
+    const int* first;
+    const int* last;
+
+    const int* begin() const { return first; }
+    const int* end() const { return last; }
+    size_t size() const { return last - first; }
+    bool empty() const { return first == last; }
+};
+
+// Compressed sparse row adjacency. Built in two passes: countArc() for
+// every arc, startFill(), fillArc() for every arc again, then finish()
+// sorts and dedups each row and compacts the target array; build() does
+// the same on several threads from an edge buffer. view() serves the
+// rows from arrays owned elsewhere (a mapped BinaryGraph) instead.
+struct CsrAdjacency {
+    ArenaVector<int> offsets;
+    ArenaVector<int> targets;
+    ArenaVector<int> cursor;
+    const int* viewOffsets = nullptr;
+    const int* viewTargets = nullptr;
+    int viewRows = 0;
+
+    // Drops the current rows; later storage comes from arena (the heap if null).
+    void setArena(Arena* arena) {
+        offsets = ArenaVector<int>(ArenaAllocator<int>(arena));
+        targets = ArenaVector<int>(ArenaAllocator<int>(arena));
+        cursor = ArenaVector<int>(ArenaAllocator<int>(arena));
+        viewOffsets = nullptr;
+    }
+
+    void reset(int numRows) {
+        offsets.assign(numRows + 1, 0);
+        targets.clear();
+        cursor.clear();
+        viewOffsets = nullptr;
+    }
+
+    // Rows become [targets + offsets[row], targets + offsets[row + 1]).
+    void view(const int* offsets, const int* targets, int numRows) {
+        viewOffsets = offsets;
+        viewTargets = targets;
+        viewRows = numRows;
+    }
+
+    void countArc(int row) {
+        offsets[row + 1]++;
+    }
+
+    void startFill() {
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        targets.resize(offsets.back());
+        cursor.assign(offsets.begin(), offsets.end() - 1);
+    }
+
+    void fillArc(int row, int target) {
+        targets[cursor[row]++] = target;
+    }
+
+    // Parallel build from numItems edges, arcs(item, add) calling
+    // add(row, target) for every arc of the item. Every thread counts the
+    // rows of its slice of the items into its own slice of cursor, a
+    // prefix sum over the rows (split between the threads) turns the
+    // counts into per-thread write positions, so the scatter shares no
+    // slot, and finish() sorts and dedups the rows in parallel.
+    template <typename Arcs>
+    void build(int numRows, size_t numItems, int numThreads, const Arcs& arcs) {
+        reset(numRows);
+        cursor.assign((size_t)numThreads * numRows, 0);
+        runWorkers(numThreads, [&](int t) {
+            int* count = cursor.data() + (size_t)t * numRows;
+            for (size_t item = numItems * t / numThreads; item < numItems * (t + 1) / numThreads; item++) {
+                arcs(item, [count](int row, int) { count[row]++; });
+            }
+        });
+        ArenaVector<int> totals(numThreads + 1, 0, cursor.get_allocator());
+        runWorkers(numThreads, [&](int p) {
+            int sum = 0;
+            for (int row = (long long)numRows * p / numThreads; row < (long long)numRows * (p + 1) / numThreads; row++) {
+                for (int t = 0; t < numThreads; t++) {
+                    sum += cursor[(size_t)t * numRows + row];
                 }
             }
-        }
-        if (maxDistance > solution)
-            solution = maxDistance;
-        //std::cout << "MaxDistance: "<< maxDistance << "\n";
+            totals[p + 1] = sum;
+        });
+        std::partial_sum(totals.begin(), totals.end(), totals.begin());
+        runWorkers(numThreads, [&](int p) {
+            int position = totals[p];
+            for (int row = (long long)numRows * p / numThreads; row < (long long)numRows * (p + 1) / numThreads; row++) {
+                offsets[row] = position;
+                for (int t = 0; t < numThreads; t++) {
+                    int& slot = cursor[(size_t)t * numRows + row];
+                    int count = slot;
+                    slot = position;
+                    position += count;
+                }
+            }
+        });
+        offsets[numRows] = totals[numThreads];
+        targets.resize(offsets[numRows]);
+        runWorkers(numThreads, [&](int t) {
+            int* next = cursor.data() + (size_t)t * numRows;
+            int* out = targets.data();
+            for (size_t item = numItems * t / numThreads; item < numItems * (t + 1) / numThreads; item++) {
+                arcs(item, [next, out](int row, int target) { out[next[row]++] = target; });
+            }
+        });
+        finish(numThreads);
     }
 
-    return solution;
-}
-
-void Information::checkContainedLines(){
-    for (int i = 1; i <= numLines; i++){
-        for (int j = 1; j <= numLines; j++){
-            if (i != j){
-                if (graphs.stationsByLine[i].size() <= graphs.stationsByLine[j].size()){
-                    bool contained = true;
-                    for (int station : graphs.stationsByLine[i]){
-                        if (graphs.stationsByLine[j].find(station) == graphs.stationsByLine[j].end()){
-                            contained = false;
-                            break;
+    // Sorts and dedups every row. Each thread takes a run of rows holding
+    // about the same number of arcs and compacts it to the run's start;
+    // the runs are then moved together and the offsets rewritten. A long
+    // row whose targets span at most 16 times its length (a line's
+    // stations on a dense network) is deduped through a bitmap instead,
+    // which emits it sorted in linear time.
+    void finish(int numThreads = 1) {
+        int numRows = rows();
+        size_t total = offsets[numRows];
+        ArenaVector<int> firstRow(numThreads + 1, numRows, cursor.get_allocator());
+        ArenaVector<int> base(numThreads + 1, 0, cursor.get_allocator());
+        ArenaVector<int> kept(numThreads + 1, 0, cursor.get_allocator());
+        for (int p = 0; p < numThreads; p++) {
+            firstRow[p] = std::lower_bound(offsets.begin(), offsets.begin() + numRows, (int)(total * p / numThreads)) - offsets.begin();
+            base[p] = offsets[firstRow[p]];
+        }
+        cursor.resize(std::max<size_t>(cursor.size(), numRows));
+        runWorkers(numThreads, [&](int p) {
+            std::vector<uint64_t> seen;
+            int write = base[p];
+            for (int row = firstRow[p]; row < firstRow[p + 1]; row++) {
+                int first = offsets[row], last = offsets[row + 1];
+                if (last - first >= 1024) {
+                    auto range = std::minmax_element(targets.begin() + first, targets.begin() + last);
+                    int low = *range.first;
+                    size_t span = (size_t)(*range.second - low) + 1;
+                    if (span <= 16 * (size_t)(last - first)) {
+                        seen.assign((span + 63) / 64, 0);
+                        for (int k = first; k < last; k++) {
+                            int bit = targets[k] - low;
+                            seen[bit >> 6] |= 1ULL << (bit & 63);
                         }
+                        int rowStart = write;
+                        for (size_t word = 0; word < seen.size(); word++) {
+                            for (uint64_t bits = seen[word]; bits; bits &= bits - 1) {
+                                targets[write++] = low + (int)(word * 64) + __builtin_ctzll(bits);
+                            }
+                        }
+                        cursor[row] = write - rowStart;
+                        continue;
                     }
-                    if (contained && !graphs.lineContainedInAnotherLine[j]){
-                        graphs.lineContainedInAnotherLine[i] = true;
-                        break;
+                }
+                std::sort(targets.begin() + first, targets.begin() + last);
+                int uniqueEnd = std::unique(targets.begin() + first, targets.begin() + last) - targets.begin();
+                cursor[row] = uniqueEnd - first;
+                for (int k = first; k < uniqueEnd; k++){
+                    targets[write++] = targets[k];
+                }
+            }
+            kept[p + 1] = write - base[p];
+        });
+        std::partial_sum(kept.begin(), kept.end(), kept.begin());
+        for (int p = 0; p < numThreads; p++) {
+            std::memmove(targets.data() + kept[p], targets.data() + base[p], sizeof(int) * (kept[p + 1] - kept[p]));
+        }
+        runWorkers(numThreads, [&](int p) {
+            int position = kept[p];
+            for (int row = firstRow[p]; row < firstRow[p + 1]; row++) {
+                offsets[row] = position;
+                position += cursor[row];
+            }
+        });
+        offsets[numRows] = kept[numThreads];
+        targets.resize(kept[numThreads]);
+        ArenaVector<int>(cursor.get_allocator()).swap(cursor);
+    }
+
+    // Rows become the transpose of source with both sides renumbered:
+    // source row sourceRows[k] (k when null) is read as row k, and its
+    // targets t land in rows newRow[t] (t when null). k only grows, so
+    // every row comes out sorted, and duplicate free like source's.
+    void transposeOf(const CsrAdjacency& source, const int* sourceRows, int numSourceRows,
+                     const int* newRow, int numRows) {
+        reset(numRows);
+        for (int k = 0; k < numSourceRows; k++) {
+            for (int target : source[sourceRows ? sourceRows[k] : k]) {
+                countArc(newRow ? newRow[target] : target);
+            }
+        }
+        startFill();
+        for (int k = 0; k < numSourceRows; k++) {
+            for (int target : source[sourceRows ? sourceRows[k] : k]) {
+                fillArc(newRow ? newRow[target] : target, k);
+            }
+        }
+        ArenaVector<int>(cursor.get_allocator()).swap(cursor);
+    }
+
+    // Rows become source's rows in a new order and under new target ids:
+    // row k is source row sourceRows[k] with every target t as newTarget[t],
+    // sorted again. Cheaper than transposeOf() when the rows are short,
+    // since it writes the targets in order.
+    void permuteOf(const CsrAdjacency& source, const int* sourceRows, int numRows, const int* newTarget) {
+        reset(numRows);
+        targets.resize(source.arcs());
+        int write = 0;
+        for (int k = 0; k < numRows; k++) {
+            int first = write;
+            for (int target : source[sourceRows[k]]) {
+                targets[write++] = newTarget[target];
+            }
+            std::sort(targets.begin() + first, targets.begin() + write);
+            offsets[k + 1] = write;
+        }
+    }
+
+    // Keeps the rows with newId[row] != 0 as rows newId[row] (in the same
+    // order) and, in them, the targets t with newId[t] != 0 as newId[t].
+    // Works in place; an increasing newId keeps the rows sorted.
+    void compact(const int* newId, int numKept) {
+        int numRows = rows();
+        int write = 0;
+        int kept = 0;
+        int first = offsets[0];
+        for (int row = 0; row < numRows; row++) {
+            int last = offsets[row + 1];
+            if (row == 0 || newId[row]) {
+                offsets[kept++] = write;
+                for (int k = first; k < last; k++) {
+                    if (newId[targets[k]]) {
+                        targets[write++] = newId[targets[k]];
                     }
                 }
             }
+            first = last;
+        }
+        offsets[kept] = write;
+        offsets.resize(numKept + 2);
+        targets.resize(write);
+    }
+
+    // Appends an already sorted, duplicate free row (rows must be added in order).
+    template <typename Row>
+    void appendRow(const Row& row) {
+        targets.insert(targets.end(), row.begin(), row.end());
+        offsets.push_back(targets.size());
+    }
+
+    int rows() const {
+        return viewOffsets ? viewRows : offsets.size() - 1;
+    }
+
+    size_t arcs() const {
+        return viewOffsets ? viewOffsets[viewRows] : targets.size();
+    }
+
+    const int* offsetData() const {
+        return viewOffsets ? viewOffsets : offsets.data();
+    }
+
+    const int* targetData() const {
+        return viewOffsets ? viewTargets : targets.data();
+    }
+
+    CsrRow operator[](int row) const {
+        if (viewOffsets) {
+            return CsrRow{viewTargets + viewOffsets[row], viewTargets + viewOffsets[row + 1]};
+        }
+        const int* base = targets.data();
+        return CsrRow{base + offsets[row], base + offsets[row + 1]};
+    }
+};
+
+// Versioned binary graph written by --convert: the header, then for
+// metroGraph, linesByStation and stationsByLine (in that order) the
+// offsets array (rows + 1 ints) followed by the sorted, duplicate free
+// targets, all native endian int32. Loading maps the file and points the
+// CSR graphs at it, so nothing is parsed or rebuilt.
+static const char binaryGraphMagic[8] = {'A', 'S', 'A', '2', 'C', 'S', 'R', '\n'};
+static const uint32_t binaryGraphVersion = 1;
+
+struct BinaryGraphHeader {
+    char magic[8];
+    uint32_t version;
+    int32_t numStations;
+    int32_t numConnections;
+    int32_t numLines;
+    int32_t metroArcs; // targets in metroGraph
+    int32_t memberArcs; // targets in linesByStation, and in stationsByLine
+};
+
+struct BinaryGraph {
+    BinaryGraphHeader header;
+    const int* metroOffsets = nullptr;
+    const int* metroTargets = nullptr;
+    const int* linesByStationOffsets = nullptr;
+    const int* linesByStationTargets = nullptr;
+    const int* stationsByLineOffsets = nullptr;
+    const int* stationsByLineTargets = nullptr;
+
+    static bool isBinary(const InputReader& reader){
+        return reader.size() >= sizeof(binaryGraphMagic)
+            && std::memcmp(reader.bytes(), binaryGraphMagic, sizeof(binaryGraphMagic)) == 0;
+    }
+
+    bool open(const InputReader& reader, std::string& error);
+};
+
+// Checks the header, the section sizes, that every offsets array is
+// non-decreasing and ends at its target count, and that every row's
+// targets are increasing ids of the other side, so the engines can index
+// with them as they do with parsed graphs.
+bool BinaryGraph::open(const InputReader& reader, std::string& error){
+    if (reader.size() < sizeof(BinaryGraphHeader) || !isBinary(reader)){
+        error = "not a binary graph";
+        return false;
+    }
+    std::memcpy(&header, reader.bytes(), sizeof(header));
+    if (header.version != binaryGraphVersion){
+        error = "unsupported binary graph version " + std::to_string(header.version);
+        return false;
+    }
+    if (header.numStations < 0 || header.numConnections < 0 || header.numLines < 0
+        || header.metroArcs < 0 || header.memberArcs < 0){
+        error = "corrupt binary graph header";
+        return false;
+    }
+    size_t stationRows = (size_t)header.numStations + 1;
+    size_t lineRows = (size_t)header.numLines + 1;
+    size_t ints = 2 * (stationRows + 1) + (lineRows + 1) + header.metroArcs + 2 * (size_t)header.memberArcs;
+    if (reader.size() != sizeof(BinaryGraphHeader) + ints * sizeof(int)){
+        error = "binary graph size does not match its header";
+        return false;
+    }
+    const int* next = (const int*)(reader.bytes() + sizeof(BinaryGraphHeader));
+    auto section = [&](const int*& offsets, const int*& targets, size_t rows, int arcs, int maxTarget) -> const char* {
+        offsets = next;
+        targets = next + rows + 1;
+        next = targets + arcs;
+        if (offsets[0] != 0 || offsets[rows] != arcs){
+            return "corrupt binary graph offsets";
+        }
+        for (size_t row = 0; row < rows; row++){
+            if (offsets[row] > offsets[row + 1]){
+                return "corrupt binary graph offsets";
+            }
+        }
+        for (size_t row = 0; row < rows; row++){
+            int previous = 0;
+            for (int k = offsets[row]; k < offsets[row + 1]; k++){
+                if (targets[k] <= previous || targets[k] > maxTarget){
+                    return "corrupt binary graph targets";
+                }
+                previous = targets[k];
+            }
         }
+        return nullptr;
+    };
+    const char* problem = section(metroOffsets, metroTargets, stationRows, header.metroArcs, header.numStations);
+    if (!problem){
+        problem = section(linesByStationOffsets, linesByStationTargets, stationRows, header.memberArcs, header.numLines);
+    }
+    if (!problem){
+        problem = section(stationsByLineOffsets, stationsByLineTargets, lineRows, header.memberArcs, header.numStations);
     }
+    if (problem){
+        error = problem;
+        return false;
+    }
+    return true;
 }
 
-int main() {
-    std::ios::sync_with_stdio(0);
-    std::cin.tie(0);
+// Disjoint sets of stations, united as the connections are parsed so
+// the stations are known to be connected (or not) once the input is read.
+struct StationSets {
+    ArenaVector<int> parent;
+    int components = 0;
+
+    void reset(int numStations, Arena* arena){
+        parent = ArenaVector<int>(ArenaAllocator<int>(arena));
+        parent.resize(numStations + 1);
+        std::iota(parent.begin(), parent.end(), 0);
+        components = numStations;
+    }
 
-    int numStations, numConnections, numLines;
-    std::cin >> numStations >> numConnections >> numLines;
+    int find(int station){
+        while (parent[station] != station){
+            parent[station] = parent[parent[station]];
+            station = parent[station];
+        }
+        return station;
+    }
+
+    void unite(int u, int v){
+        u = find(u);
+        v = find(v);
+        if (u != v){
+            parent[std::max(u, v)] = std::min(u, v);
+            components--;
+        }
+    }
+};
 
-    Information info(numStations, numConnections, numLines);
+// Fewest records a SpillRuns buffer or run block holds.
+static const size_t spillBlock = 1024;
+
+// Record of the external-memory solver: a packed key and how many times
+// it was added.
+struct SpillRecord {
+    uint64_t key;
+    uint32_t count;
+};
 
-    std::cout << info.getSolution() << "\n";
+// Multiset of SpillRecords larger than memory. Records are buffered; a
+// full buffer is sorted and combined (equal keys add their counts), and
+// if that leaves it over half full it is appended as a sorted run to an
+// unlinked temporary file. merge() then streams every distinct key in
+// order with its total count, through a k-way merge of the runs that
+// reads each run with its own block buffer. When everything fits in the
+// buffer nothing touches the disk. Once merged no more keys can be added,
+// but merge() can be called again to stream them once more.
+class SpillRuns {
+private:
+    std::string directory;
+    size_t capacity;
+    std::vector<SpillRecord> buffer;
+    FILE* file = nullptr;
+    std::vector<std::pair<long long, size_t>> runs; // first record and length of every run
+    Profile& profile;
+
+    void combine(){
+        std::sort(buffer.begin(), buffer.end(), [](const SpillRecord& a, const SpillRecord& b){
+            return a.key < b.key;
+        });
+        size_t write = 0;
+        for (size_t k = 0; k < buffer.size(); k++){
+            if (write > 0 && buffer[write - 1].key == buffer[k].key){
+                buffer[write - 1].count += buffer[k].count;
+            } else {
+                buffer[write++] = buffer[k];
+            }
+        }
+        buffer.resize(write);
+    }
+
+    bool spill(){
+        if (!file){
+            std::string path = directory + "/projeto2-spill-XXXXXX";
+            int fd = mkstemp(&path[0]);
+            if (fd < 0){
+                return false;
+            }
+            unlink(path.c_str());
+            file = fdopen(fd, "w+b");
+            if (!file){
+                close(fd);
+                return false;
+            }
+        }
+        if (fseeko(file, 0, SEEK_END) != 0){
+            return false;
+        }
+        long long first = ftello(file) / sizeof(SpillRecord);
+        if (std::fwrite(buffer.data(), sizeof(SpillRecord), buffer.size(), file) != buffer.size()){
+            return false;
+        }
+        runs.push_back(std::make_pair(first, buffer.size()));
+        profile.spilledBytes += buffer.size() * sizeof(SpillRecord);
+        profile.spilledRuns++;
+        buffer.clear();
+        return true;
+    }
+
+    // k-way merge of the first numRuns runs, reading each through its
+    // share of readBytes (at least spillBlock records).
+    template <typename Emit>
+    bool mergeRuns(size_t numRuns, size_t readBytes, Emit emit){
+        size_t block = std::max<size_t>(readBytes / sizeof(SpillRecord) / numRuns, spillBlock);
+        struct RunReader {
+            std::vector<SpillRecord> records;
+            size_t at = 0;
+            long long next;
+            size_t left;
+        };
+        std::vector<RunReader> readers(numRuns);
+        auto refill = [&](RunReader& reader){
+            size_t n = std::min(block, reader.left);
+            reader.records.resize(n);
+            reader.at = 0;
+            if (n == 0){
+                return true;
+            }
+            if (fseeko(file, (off_t)(reader.next * sizeof(SpillRecord)), SEEK_SET) != 0
+                || std::fread(reader.records.data(), sizeof(SpillRecord), n, file) != n){
+                return false;
+            }
+            reader.next += n;
+            reader.left -= n;
+            return true;
+        };
+        typedef std::pair<uint64_t, size_t> HeapEntry; // key, run
+        std::priority_queue<HeapEntry, std::vector<HeapEntry>, std::greater<HeapEntry>> heap;
+        for (size_t run = 0; run < numRuns; run++){
+            readers[run].next = runs[run].first;
+            readers[run].left = runs[run].second;
+            if (!refill(readers[run])){
+                return false;
+            }
+            if (!readers[run].records.empty()){
+                heap.push(HeapEntry(readers[run].records[0].key, run));
+            }
+        }
+        bool have = false;
+        uint64_t key = 0;
+        uint64_t count = 0;
+        while (!heap.empty()){
+            RunReader& reader = readers[heap.top().second];
+            size_t run = heap.top().second;
+            heap.pop();
+            const SpillRecord& record = reader.records[reader.at++];
+            if (have && record.key == key){
+                count += record.count;
+            } else {
+                if (have){
+                    emit(key, (uint32_t)count);
+                }
+                have = true;
+                key = record.key;
+                count = record.count;
+            }
+            if (reader.at == reader.records.size() && !refill(reader)){
+                return false;
+            }
+            if (reader.at < reader.records.size()){
+                heap.push(HeapEntry(reader.records[reader.at].key, run));
+            }
+        }
+        if (have){
+            emit(key, (uint32_t)count);
+        }
+        return true;
+    }
+
+public:
+    SpillRuns(const std::string& directory, size_t bufferBytes, Profile& profile)
+        : directory(directory), capacity(std::max<size_t>(bufferBytes / sizeof(SpillRecord), spillBlock)),
+          profile(profile) {}
+
+    ~SpillRuns(){
+        if (file){
+            std::fclose(file);
+        }
+    }
+
+    // False when a spill could not be written.
+    // The buffer is only reserved here, so runs can be set up before the
+    // memory of an earlier stage is given back.
+    bool add(uint64_t key, uint32_t count = 1){
+        if (buffer.capacity() < capacity){
+            buffer.reserve(capacity);
+        }
+        buffer.push_back(SpillRecord{key, count});
+        if (buffer.size() < capacity){
+            return true;
+        }
+        combine();
+        return buffer.size() <= capacity / 2 || spill();
+    }
+
+    // Calls emit(key, count) for every distinct key in increasing order,
+    // reading the runs through readBytes of buffers in all. When nothing
+    // was spilled the add buffer is kept and read instead; otherwise it is
+    // spilled and released first. False on a read or write error.
+    template <typename Emit>
+    bool merge(size_t readBytes, Emit emit){
+        if (runs.empty()){
+            combine();
+            for (const SpillRecord& record : buffer){
+                emit(record.key, record.count);
+            }
+            return true;
+        }
+        if (!buffer.empty()){
+            combine();
+            if (!spill()){
+                return false;
+            }
+        }
+        std::vector<SpillRecord>().swap(buffer);
+        // Too many runs to give each a block of readBytes: the oldest are
+        // merged into longer runs at the end of the file first, half of
+        // readBytes reading them and half writing.
+        size_t finalRuns = std::max<size_t>(readBytes / (spillBlock * sizeof(SpillRecord)), 2);
+        size_t passRuns = std::max<size_t>(finalRuns / 2, 2);
+        size_t outputSize = std::max<size_t>(readBytes / 2 / sizeof(SpillRecord), spillBlock);
+        while (runs.size() > finalRuns){
+            size_t count = std::min(passRuns, runs.size() - finalRuns + 1);
+            if (fseeko(file, 0, SEEK_END) != 0){
+                return false;
+            }
+            long long first = ftello(file) / sizeof(SpillRecord);
+            size_t length = 0;
+            bool written = true;
+            std::vector<SpillRecord> output;
+            output.reserve(outputSize);
+            auto flush = [&](){
+                written = written && fseeko(file, 0, SEEK_END) == 0
+                    && std::fwrite(output.data(), sizeof(SpillRecord), output.size(), file) == output.size();
+                profile.spilledBytes += output.size() * sizeof(SpillRecord);
+                length += output.size();
+                output.clear();
+            };
+            bool read = mergeRuns(count, readBytes / 2, [&](uint64_t key, uint32_t total){
+                output.push_back(SpillRecord{key, total});
+                if (output.size() == outputSize){
+                    flush();
+                }
+            });
+            flush();
+            if (!read || !written){
+                return false;
+            }
+            runs.erase(runs.begin(), runs.begin() + count);
+            runs.push_back(std::make_pair(first, length));
+            profile.spilledRuns++;
+        }
+        return mergeRuns(runs.size(), readBytes, emit);
+    }
+};
+
+struct Graphs {
+    std::vector<std::unordered_set<int>> metroGraph; // represents the full metro system
+    std::vector<std::unordered_set<int>> linesGraph; // represents the full metro system
+    std::vector<std::unordered_set<int>> linesByStation;
+    std::vector<std::unordered_set<int>> stationsByLine;
+    std::vector<bool> lineContainedInAnotherLine;
+};
+
+// Destination of --eccentricities and --distances; a null file is skipped.
+struct LineDistanceOutput {
+    FILE* eccentricities = nullptr;
+    FILE* distances = nullptr;
+    bool binary = false;
+};
+
+// Same graphs as Graphs, in CSR form (rows are sorted).
+struct CsrGraphs {
+    CsrAdjacency metroGraph;
+    CsrAdjacency linesGraph;
+    CsrAdjacency linesByStation;
+    CsrAdjacency stationsByLine;
+};
+
+class Information {
+private:
+    int numConnections;
+    int numStations;
+    int numLines;
+    int solution;
+    Profile profile;
+    SolverOptions options;
+    InputCursor* input = nullptr;
+    InputCursor firstConnection = InputCursor{nullptr, nullptr, false}; // --lean: where the second parse starts
+    Graphs graphs;
+    CsrGraphs csr;
+    Arena arena; // backs the CSR graphs and the scratch of every stage
+    ArenaVector<Connection> connections;
+    StationSets stationSets;
+    LineDistanceOutput* distanceOutput = nullptr;
+    // --relabel: new id of every input station and line, and back (empty otherwise)
+    ArenaVector<int> newStation, originalStation, newLine, originalLine;
+    int reducedLines = -1; // vertices of csr.linesGraph once mergeTwinLines() ran
+    int twinDistance = 0; // distance between two merged twins, a lower bound on the answer
+    int upperBound = -1; // --approximate: proven upper bound on the answer, -1 when solved exactly
+    std::chrono::steady_clock::time_point started; // of the current solve, for --budget-ms
+
+    void buildCsrGraphs(const ArenaVector<Connection>& connections, bool withMetroGraph);
+    void buildLeanGraphs();
+    void relabel();
+    void mergeTwinLines();
+    void resetArena();
+    bool startInstance(int numStations, int numConnections, int numLines);
+    int solveBuilt(bool connectivityKnown);
+    template <typename Adjacency, typename Scratch>
+    void adjacentLines(int line, const Adjacency& stationsByLine, const Adjacency& linesByStation,
+                       Scratch& mark, Scratch& row);
+
+    template <typename Adjacency>
+    bool stationsReachable(const Adjacency& metroGraph);
+    template <typename Adjacency>
+    void markContainedLines(const Adjacency& stationsByLine);
+
+public:
+    explicit Information(const SolverOptions& options = SolverOptions());
+    Information(InputCursor& input, int numStations, int numConnections, int numLines,
+                const SolverOptions& options = SolverOptions());
+    int solve(InputCursor& input, int numStations, int numConnections, int numLines);
+    int solve(const BinaryGraph& graph);
+    bool writeBinary(InputCursor& input, int numStations, int numConnections, int numLines, const char* path);
+    bool solveExternal(InputCursor& input, int numStations, int numConnections, int numLines);
+    void buildMetroGraph();
+    bool isolatedStationsExist();
+    bool systemBFS();
+    void buildLinesGraph();
+    void checkContainedLines();
+    int resultsBFS();
+
+    //Debugging
+    void printLinesGraph();
+    void printMetroGraph();
+    void printLinesByStation();
+
+    int getSolution() const;
+    int getUpperBound() const;
+    const Profile& getProfile() const;
+    std::string profileJson() const;
+    const Arena& getArena() const;
+    void setDistanceOutput(LineDistanceOutput* output);
+    void buildTransferGraphs(InputCursor& input, int numStations, int numConnections, int numLines);
+    const CsrGraphs& getCsrGraphs() const;
+    int relabeledStation(int station) const;
+};
+
+Information::Information(const SolverOptions& options)
+    : numConnections(0), numStations(0), numLines(0), solution(0), options(options) {
+}
+
+Information::Information(InputCursor& input, int numStations, int numConnections, int numLines,
+                         const SolverOptions& options)
+    : Information(options) {
+        solve(input, numStations, numConnections, numLines);
+}
+
+// Resets a sets adjacency to numRows empty rows, keeping the existing
+// sets (and their buckets) alive for reuse.
+static void resetRows(std::vector<std::unordered_set<int>>& rows, int numRows){
+    for (size_t row = 0; row < rows.size() && row < (size_t)numRows; row++){
+        rows[row].clear();
+    }
+    rows.resize(numRows);
+}
+
+// Resets the per-instance state for an instance of the given size.
+// Returns false when the answer is already known (a single station).
+bool Information::startInstance(int numStations, int numConnections, int numLines){
+        this->numStations = numStations;
+        this->numConnections = numConnections;
+        this->numLines = numLines;
+        solution = 0;
+        reducedLines = -1;
+        twinDistance = 0;
+        upperBound = -1;
+        started = std::chrono::steady_clock::now();
+        profile.reset();
+        if (numStations == 1){
+            return false;
+        }
+        graphs.lineContainedInAnotherLine.assign(numLines + 1, false);
+        if (options.layout == GraphLayout::Csr){
+            resetArena();
+        }
+        if (options.layout == GraphLayout::Sets){
+            resetRows(graphs.metroGraph, numStations + 1);
+            resetRows(graphs.linesGraph, numLines + 1);
+            resetRows(graphs.linesByStation, numStations + 1);
+            resetRows(graphs.stationsByLine, numLines + 1);
+        }
+        return true;
+}
+
+// Solves one instance whose header has already been read from input.
+// Buffers from the previous solve() are reused. Connectivity comes from
+// the union-find filled while parsing: a disconnected instance (which
+// includes any isolated station) is answered before anything is built,
+// and metroGraph is never built since nothing else reads it.
+int Information::solve(InputCursor& input, int numStations, int numConnections, int numLines){
+        this->input = &input;
+        if (!startInstance(numStations, numConnections, numLines)){
+            input.skipInts(3LL * numConnections);
+            return solution;
+        }
+        CacheMissCounter misses(profile, options.profile);
+        stationSets.reset(numStations, options.layout == GraphLayout::Csr ? &arena : nullptr);
+        buildMetroGraph();
+        if (stationSets.components > 1){
+            solution = -1;
+            return solution;
+        }
+        if (options.layout == GraphLayout::Csr){
+            PhaseTimer timer(profile, PhaseBuildMetroGraph);
+            if (options.lean){
+                buildLeanGraphs();
+            } else {
+                buildCsrGraphs(connections, false);
+            }
+        }
+        return solveBuilt(true);
+}
+
+// Puts back the layout options a CSR only path overrides when it returns,
+// so a reused Information (batch, --convert) keeps solving the next
+// instances with the layout the caller chose.
+class LayoutOverride {
+private:
+    SolverOptions& options;
+    GraphLayout layout;
+    bool lean;
+    Relabeling relabel;
+
+public:
+    explicit LayoutOverride(SolverOptions& options)
+        : options(options), layout(options.layout), lean(options.lean), relabel(options.relabel) {}
+    ~LayoutOverride(){
+        options.layout = layout;
+        options.lean = lean;
+        options.relabel = relabel;
+    }
+};
+
+// Solves a mapped binary graph: the CSR graphs are pointed at its arrays
+// and solving starts right after, with no parse or build phase. Binary
+// graphs only come in CSR form, so the layout is Csr for the call.
+int Information::solve(const BinaryGraph& graph){
+        LayoutOverride restore(options);
+        options.layout = GraphLayout::Csr;
+        input = nullptr;
+        if (!startInstance(graph.header.numStations, graph.header.numConnections, graph.header.numLines)){
+            return solution;
+        }
+        CacheMissCounter misses(profile, options.profile);
+        {
+            PhaseTimer timer(profile, PhaseParse);
+            csr.metroGraph.view(graph.metroOffsets, graph.metroTargets, numStations + 1);
+            csr.linesByStation.view(graph.linesByStationOffsets, graph.linesByStationTargets, numStations + 1);
+            csr.stationsByLine.view(graph.stationsByLineOffsets, graph.stationsByLineTargets, numLines + 1);
+        }
+        return solveBuilt(false);
+}
+
+// Parses the instance into the CSR graphs and writes them to path in the
+// BinaryGraph format.
+bool Information::writeBinary(InputCursor& input, int numStations, int numConnections, int numLines,
+                              const char* path){
+        LayoutOverride restore(options);
+        options.layout = GraphLayout::Csr;
+        options.lean = false;
+        this->input = &input;
+        this->numStations = numStations;
+        this->numConnections = numConnections;
+        this->numLines = numLines;
+        resetArena();
+        stationSets.reset(numStations, &arena);
+        buildMetroGraph();
+        buildCsrGraphs(connections, true);
+
+        BinaryGraphHeader header;
+        std::memcpy(header.magic, binaryGraphMagic, sizeof(header.magic));
+        header.version = binaryGraphVersion;
+        header.numStations = numStations;
+        header.numConnections = numConnections;
+        header.numLines = numLines;
+        header.metroArcs = csr.metroGraph.arcs();
+        header.memberArcs = csr.stationsByLine.arcs();
+        FILE* file = std::fopen(path, "wb");
+        if (!file){
+            return false;
+        }
+        bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        for (const CsrAdjacency* graph : {&csr.metroGraph, &csr.linesByStation, &csr.stationsByLine}){
+            size_t rows = graph->rows();
+            ok = ok && std::fwrite(graph->offsetData(), sizeof(int), rows + 1, file) == rows + 1;
+            ok = ok && std::fwrite(graph->targetData(), sizeof(int), graph->arcs(), file) == graph->arcs();
+        }
+        return std::fclose(file) == 0 && ok;
+}
+
+// --memory-mb: solves the instance without holding its connections or
+// line memberships, with options.memoryMb of buffers:
+// - parse: one pass over the input unites the stations and spills the
+//   (station, line) memberships, dropping the input pages behind it;
+// - merging the memberships gives every station's lines in turn, which
+//   count the stations of every line and spill each pair of lines that
+//   share the station (or count it in a line by line matrix when that
+//   fits, as it does for a few hundred lines);
+// - merging the pairs gives, for every pair of lines, how many stations
+//   they share: line i holds a subset of line j's stations exactly when
+//   that is all of i's, which marks the contained lines;
+// - two more merges count and fill the line graph from the pairs with no
+//   contained line.
+// Each stage has half of the buffers: the memberships and then the pairs
+// are added to one half while the other half reads the previous stage.
+// The union-find, line sized arrays and the line graph stay in memory on
+// top of the buffers. From the line graph on it is the in-memory path, so
+// the answers are the same. False when a spill fails.
+bool Information::solveExternal(InputCursor& input, int numStations, int numConnections, int numLines){
+        LayoutOverride restore(options);
+        options.layout = GraphLayout::Csr;
+        options.lean = false;
+        options.relabel = Relabeling::None;
+        this->input = &input;
+        if (!startInstance(numStations, numConnections, numLines)){
+            input.skipInts(3LL * numConnections);
+            return true;
+        }
+        CacheMissCounter misses(profile, options.profile);
+        size_t budget = (size_t)options.memoryMb << 20;
+        const char* environment = std::getenv("TMPDIR");
+        std::string directory = options.tempDir ? options.tempDir : environment ? environment : "/tmp";
+        auto pack = [](int high, int low){
+            return (uint64_t)(uint32_t)high << 32 | (uint32_t)low;
+        };
+        stationSets.reset(numStations, &arena);
+        ArenaVector<int> lineSize(numLines + 1, 0, ArenaAllocator<int>(&arena));
+        size_t half = budget / 2;
+        SpillRuns pairs(directory, half, profile);
+        size_t side = numLines + 1;
+        std::vector<uint32_t> pairMatrix; // shared stations of lines a < b at a * side + b
+        bool densePairs = side * side * sizeof(uint32_t) <= half;
+        {
+            SpillRuns memberships(directory, half, profile);
+            {
+                PhaseTimer timer(profile, PhaseParse);
+                const char* released = input.pos;
+                int u = 0, v = 0, line = 0;
+                for (int i = 0; i < numConnections; i++){
+                    input.nextInt(u);
+                    input.nextInt(v);
+                    input.nextInt(line);
+                    stationSets.unite(u, v);
+                    if (!memberships.add(pack(u, line)) || !memberships.add(pack(v, line))){
+                        return false;
+                    }
+                    if ((i & 0xFFFF) == 0xFFFF){
+                        input.releaseBefore(released);
+                        released = input.pos;
+                    }
+                }
+                input.releaseBefore(released);
+            }
+            if (stationSets.components > 1){
+                solution = -1;
+                return true;
+            }
+            PhaseTimer timer(profile, PhaseBuildMetroGraph);
+            std::vector<int> lines;
+            if (densePairs){
+                pairMatrix.assign(side * side, 0);
+            }
+            int station = 0;
+            bool written = true;
+            auto flush = [&](){
+                for (size_t a = 0; a < lines.size(); a++){
+                    lineSize[lines[a]]++;
+                    for (size_t b = a + 1; b < lines.size(); b++){
+                        if (densePairs){
+                            pairMatrix[lines[a] * side + lines[b]]++;
+                        } else {
+                            written = written && pairs.add(pack(lines[a], lines[b]));
+                        }
+                    }
+                }
+                lines.clear();
+            };
+            bool read = memberships.merge(half, [&](uint64_t key, uint32_t){
+                if ((int)(key >> 32) != station){
+                    flush();
+                    station = key >> 32;
+                }
+                lines.push_back((int)(uint32_t)key);
+            });
+            flush();
+            if (!read || !written){
+                return false;
+            }
+        }
+
+        // Streams every pair of lines that share a station, with how many,
+        // from the matrix or from the given runs.
+        auto eachPair = [&](SpillRuns& runs, const std::function<void(int, int, int)>& emit){
+            if (!densePairs){
+                return runs.merge(half, [&](uint64_t key, uint32_t count){
+                    emit((int)(key >> 32), (int)(uint32_t)key, (int)count);
+                });
+            }
+            for (int a = 1; a <= numLines; a++){
+                for (int b = a + 1; b <= numLines; b++){
+                    if (pairMatrix[a * side + b]){
+                        emit(a, b, (int)pairMatrix[a * side + b]);
+                    }
+                }
+            }
+            return true;
+        };
+        std::vector<bool>& contained = graphs.lineContainedInAnotherLine;
+        SpillRuns distinct(directory, half, profile);
+        {
+            PhaseTimer timer(profile, PhaseContainedLines);
+            // The same lines markBitmapContainedLines() marks, without its
+            // order: a line is kept only if no larger line holds it and no
+            // later one has the same stations. The network is connected, so
+            // some line has stations and every empty line is contained.
+            // The merged pairs are copied to distinct, which spills them
+            // in a few sorted runs once they outgrow half the buffers, so
+            // the line graph does not merge the runs of every station again.
+            for (int i = 1; i <= numLines; i++){
+                contained[i] = lineSize[i] == 0;
+            }
+            bool written = true;
+            bool read = eachPair(pairs, [&](int a, int b, int count){
+                if (count == lineSize[a] && lineSize[b] >= lineSize[a]){
+                    contained[a] = true;
+                } else if (count == lineSize[b] && lineSize[a] > lineSize[b]){
+                    contained[b] = true;
+                }
+                if (!densePairs){
+                    written = written && distinct.add(pack(a, b), count);
+                }
+            });
+            if (!read || !written){
+                return false;
+            }
+        }
+        {
+            PhaseTimer timer(profile, PhaseLinesGraph);
+            csr.linesGraph.reset(numLines + 1);
+            bool read = eachPair(distinct, [&](int a, int b, int){
+                if (!contained[a] && !contained[b]){
+                    csr.linesGraph.countArc(a);
+                    csr.linesGraph.countArc(b);
+                }
+            });
+            csr.linesGraph.startFill();
+            read = read && eachPair(distinct, [&](int a, int b, int){
+                if (!contained[a] && !contained[b]){
+                    csr.linesGraph.fillArc(a, b);
+                    csr.linesGraph.fillArc(b, a);
+                }
+            });
+            std::vector<uint32_t>().swap(pairMatrix);
+            if (!read){
+                return false;
+            }
+            csr.linesGraph.finish();
+            if (options.reduce == LineReduction::Twins && !distanceOutput){
+                mergeTwinLines();
+            }
+        }
+        PhaseTimer timer(profile, PhaseResultsBFS);
+        solution = resultsBFS();
+        return true;
+}
+
+// Every phase after the graphs are built, up to the answer. Unless
+// connectivityKnown, the stations are checked on metroGraph.
+int Information::solveBuilt(bool connectivityKnown){
+        if (options.relabel != Relabeling::None && options.layout == GraphLayout::Csr){
+            PhaseTimer timer(profile, PhaseBuildMetroGraph);
+            relabel();
+        }
+        bool isolated = false;
+        if (!connectivityKnown){
+            PhaseTimer timer(profile, PhaseIsolatedStations);
+            isolated = isolatedStationsExist();
+        }
+        if (isolated){
+            solution = -1;
+            return solution;
+        }
+        {
+            PhaseTimer timer(profile, PhaseContainedLines);
+            checkContainedLines();
+        }
+        bool connected = true;
+        if (!connectivityKnown){
+            PhaseTimer timer(profile, PhaseSystemBFS);
+            connected = systemBFS();
+        }
+        if (!connected){
+            solution = -1;
+            return solution;
+        }
+        {
+            PhaseTimer timer(profile, PhaseLinesGraph);
+            buildLinesGraph();
+            if (options.reduce == LineReduction::Twins && options.layout == GraphLayout::Csr && !distanceOutput){
+                mergeTwinLines();
+            }
+        }
+        //printLinesGraph();
+        PhaseTimer timer(profile, PhaseResultsBFS);
+        solution = resultsBFS();
+        return solution;
+
+}
+
+int Information::getSolution() const{
+    return solution;
+}
+
+// Equal to getSolution() unless --approximate stopped before the bounds met.
+int Information::getUpperBound() const{
+    return upperBound >= 0 ? std::max(upperBound, solution) : solution;
+}
+
+const Profile& Information::getProfile() const{
+    return profile;
+}
+
+// One line of JSON with the instance size, answer, phase times in
+// milliseconds and, in PROFILE_COUNTERS builds, the work counters.
+std::string Information::profileJson() const{
+    std::ostringstream json;
+    json << "{\"stations\":" << numStations << ",\"connections\":" << numConnections
+         << ",\"lines\":" << numLines << ",\"solution\":" << solution << ",\"phases_ms\":{";
+    for (int phase = 0; phase < NumPhases; phase++){
+        json << (phase ? "," : "") << "\"" << phaseNames[phase] << "\":" << profile.seconds[phase] * 1000;
+    }
+    json << "},\"bfs_runs\":" << profile.bfsRuns << ",\"cache_misses\":" << profile.cacheMisses
+         << ",\"line_graph_lines\":" << profile.lineGraphLines << ",\"reduced_lines\":" << profile.reducedLines;
+#ifdef PROFILE_COUNTERS
+    json << ",\"counters\":{\"edgesScanned\":" << profile.edgesScanned
+         << ",\"nodesExpanded\":" << profile.nodesExpanded
+         << ",\"subsetTests\":" << profile.subsetTests << "}";
+#endif
+    json << "}";
+    return json.str();
+}
+
+const Arena& Information::getArena() const{
+    return arena;
+}
+
+// Builds linesByStation, the contained lines and the line graph for
+// --query whatever the answer would be, skipping the connectivity checks.
+void Information::buildTransferGraphs(InputCursor& input, int numStations, int numConnections, int numLines){
+        LayoutOverride restore(options);
+        options.layout = GraphLayout::Csr;
+        options.lean = false;
+        this->input = &input;
+        if (!startInstance(numStations, numConnections, numLines)){
+            // One station: every query is from == to and needs no graph,
+            // but the oracle is still built over them, so they are set up
+            // as for any other network.
+            graphs.lineContainedInAnotherLine.assign(numLines + 1, false);
+            resetArena();
+        }
+        stationSets.reset(numStations, &arena);
+        buildMetroGraph();
+        {
+            PhaseTimer timer(profile, PhaseBuildMetroGraph);
+            buildCsrGraphs(connections, false);
+            if (options.relabel != Relabeling::None){
+                relabel();
+            }
+        }
+        {
+            PhaseTimer timer(profile, PhaseContainedLines);
+            checkContainedLines();
+        }
+        PhaseTimer timer(profile, PhaseLinesGraph);
+        buildLinesGraph();
+}
+
+const CsrGraphs& Information::getCsrGraphs() const{
+    return csr;
+}
+
+// Id of an input station in the graphs, which --relabel may renumber.
+int Information::relabeledStation(int station) const{
+    return newStation.empty() ? station : newStation[station];
+}
+
+// resultsBFS() also writes the per-line results to output from then on.
+void Information::setDistanceOutput(LineDistanceOutput* output){
+    distanceOutput = output;
+}
+
+// Releases the previous instance's arena storage and sizes the arena for
+// this one from its header: the connection buffer, the three CSR graphs
+// with their per-thread build counts, the line graph (capped at 4E targets, a
+// denser one spills into a second block), the line bitmaps and the BFS
+// scratch of every worker thread, plus the id maps and renumbered graphs
+// of --relabel. Overestimating only costs address space, pages that are
+// never touched are never committed.
+void Information::resetArena(){
+    connections = ArenaVector<Connection>(ArenaAllocator<Connection>(&arena));
+    csr.metroGraph.setArena(&arena);
+    csr.linesGraph.setArena(&arena);
+    csr.linesByStation.setArena(&arena);
+    csr.stationsByLine.setArena(&arena);
+    for (ArenaVector<int>* ids : {&newStation, &originalStation, &newLine, &originalLine}){
+        *ids = ArenaVector<int>(ArenaAllocator<int>(&arena));
+    }
+
+    size_t stations = numStations + 2;
+    size_t lines = numLines + 2;
+    size_t arcs = 2 * (size_t)numConnections;
+    size_t threads = resolveThreads(options.numThreads);
+    size_t bytes = numConnections * sizeof(Connection);
+    bytes += sizeof(int) * (2 * (stations + arcs) + (lines + arcs));
+    bytes += sizeof(int) * (std::min(threads * stations, arcs) * 2 + std::min(threads * lines, arcs) + 6 * threads);
+    bytes += sizeof(int) * (lines + std::min<size_t>((size_t)numLines * numLines, 2 * arcs));
+    bytes += sizeof(int) * 2 * stations + sizeof(int) * 2 * lines;
+    bytes += (sizeof(int) + sizeof(uint64_t)) * arcs + (3 * sizeof(int) + 2 * sizeof(uint64_t)) * lines;
+    bytes += threads * std::max(2 * sizeof(int), 3 * 4 * sizeof(uint64_t)) * lines;
+    if (options.relabel != Relabeling::None){
+        bytes += sizeof(int) * (3 * (stations + lines) + 3 * (stations + arcs) + (lines + arcs));
+    }
+    if (options.memoryMb > 0){
+        // solveExternal() keeps no per connection array: the union-find,
+        // line sized arrays, and a first guess at the line graph, which
+        // continues in further blocks when it is denser.
+        bytes = sizeof(int) * (stations + 2 * lines + 16 * lines);
+        bytes += (3 * sizeof(int) + 2 * sizeof(uint64_t)) * lines;
+        bytes += threads * std::max(2 * sizeof(int), 3 * 4 * sizeof(uint64_t)) * lines;
+    }
+    bytes += 64 * 64; // alignment slack
+    arena.reset(bytes);
+}
+
+void Information::printLinesByStation(){
+    for (int i = 1; i <= numStations; i++){
+        std::cout << "Station " << i << " is in lines: ";
+        if (options.layout == GraphLayout::Csr){
+            for (int line : csr.linesByStation[i]){
+                std::cout << line << " ";
+            }
+        } else {
+            for (int line : graphs.linesByStation[i]){
+                std::cout << line << " ";
+            }
+        }
+        std::cout << "\n";
+    }
+}
+
+// Parses the connections, uniting their stations in stationSets. The CSR
+// layout keeps them for buildCsrGraphs(), or with --lean only counts the
+// stations of every line for buildLeanGraphs(); the sets layout fills the
+// line membership sets directly.
+void Information::buildMetroGraph() {
+    int u = 0, v = 0, line = 0;
+    if (options.layout == GraphLayout::Csr && options.lean){
+        PhaseTimer timer(profile, PhaseParse);
+        firstConnection = *input;
+        const char* released = input->pos;
+        csr.stationsByLine.reset(numLines + 1);
+        for (int i = 0; i < numConnections; i++) {
+            input->nextInt(u);
+            input->nextInt(v);
+            input->nextInt(line);
+            stationSets.unite(u, v);
+            csr.stationsByLine.countArc(line);
+            csr.stationsByLine.countArc(line);
+            if ((i & 0xFFFF) == 0xFFFF) {
+                input->releaseBefore(released);
+                released = input->pos;
+            }
+        }
+        input->releaseBefore(released);
+        return;
+    }
+    if (options.layout == GraphLayout::Csr){
+        PhaseTimer timer(profile, PhaseParse);
+        connections.resize(numConnections);
+        for (int i = 0; i < numConnections; i++) {
+            input->nextInt(connections[i].u);
+            input->nextInt(connections[i].v);
+            input->nextInt(connections[i].line);
+            stationSets.unite(connections[i].u, connections[i].v);
+        }
+        return;
+    }
+    //printMetroGraph();
+    // The sets path inserts while parsing, so the parse phase includes the inserts.
+    PhaseTimer timer(profile, PhaseParse);
+    for (int i = 0; i < numConnections; i++) {
+        input->nextInt(u);
+        input->nextInt(v);
+        input->nextInt(line);
+        //std::cout << "\nU: " << u << " V: " << v << " Line: " << line << "\n";
+        stationSets.unite(u, v);
+        graphs.linesByStation[u].insert(line);
+        graphs.linesByStation[v].insert(line);
+        graphs.stationsByLine[line].insert(u);
+        graphs.stationsByLine[line].insert(v);
+        //printMetroGraph();
+    }
+}
+
+// Arcs of one connection in each CSR graph, for CsrAdjacency::build.
+struct MetroArcs {
+    const Connection* connections;
+    template <typename Add>
+    void operator()(size_t i, Add add) const {
+        add(connections[i].u, connections[i].v);
+        add(connections[i].v, connections[i].u);
+    }
+};
+
+struct LinesByStationArcs {
+    const Connection* connections;
+    template <typename Add>
+    void operator()(size_t i, Add add) const {
+        add(connections[i].u, connections[i].line);
+        add(connections[i].v, connections[i].line);
+    }
+};
+
+struct StationsByLineArcs {
+    const Connection* connections;
+    template <typename Add>
+    void operator()(size_t i, Add add) const {
+        add(connections[i].line, connections[i].u);
+        add(connections[i].line, connections[i].v);
+    }
+};
+
+// Two pass CSR build: count the degree of every row, prefix sum the
+// counts into offsets, scatter the targets, then sort+dedup each row,
+// all split over the connections (CsrAdjacency::build). A graph gets at
+// most arcs / rows threads, so the per-thread counts never outgrow its
+// targets, and small instances are built on one thread.
+// metroGraph is left empty unless withMetroGraph.
+void Information::buildCsrGraphs(const ArenaVector<Connection>& connections, bool withMetroGraph) {
+    size_t numEdges = connections.size();
+    int threads = numEdges < (1 << 16) ? 1 : resolveThreads(options.numThreads);
+    auto threadsFor = [&](int numRows){
+        return (int)std::max<size_t>(1, std::min<size_t>(threads, 2 * numEdges / numRows));
+    };
+    csr.metroGraph.reset(0);
+    if (withMetroGraph){
+        csr.metroGraph.build(numStations + 1, numEdges, threadsFor(numStations + 1), MetroArcs{connections.data()});
+    }
+    csr.linesByStation.build(numStations + 1, numEdges, threadsFor(numStations + 1),
+                             LinesByStationArcs{connections.data()});
+    csr.stationsByLine.build(numLines + 1, numEdges, threadsFor(numLines + 1),
+                             StationsByLineArcs{connections.data()});
+}
+
+// --lean build: parses the connections a second time straight into
+// stationsByLine, then transposes its deduplicated rows into
+// linesByStation, so the only arrays ever held are the two membership
+// graphs (plus the raw stationsByLine arcs before dedup). Both parses
+// drop the input pages behind them, so the text is never resident whole.
+void Information::buildLeanGraphs() {
+    InputCursor cursor = firstConnection;
+    const char* released = cursor.pos;
+    int u = 0, v = 0, line = 0;
+    csr.stationsByLine.startFill();
+    for (int i = 0; i < numConnections; i++) {
+        cursor.nextInt(u);
+        cursor.nextInt(v);
+        cursor.nextInt(line);
+        csr.stationsByLine.fillArc(line, u);
+        csr.stationsByLine.fillArc(line, v);
+        if ((i & 0xFFFF) == 0xFFFF) {
+            cursor.releaseBefore(released);
+            released = cursor.pos;
+        }
+    }
+    cursor.releaseBefore(released);
+    csr.stationsByLine.finish();
+    csr.linesByStation.reset(numStations + 1);
+    for (int line = 1; line <= numLines; line++){
+        for (int station : csr.stationsByLine[line]){
+            csr.linesByStation.countArc(station);
+        }
+    }
+    csr.linesByStation.startFill();
+    for (int line = 1; line <= numLines; line++){
+        for (int station : csr.stationsByLine[line]){
+            csr.linesByStation.fillArc(station, line);
+        }
+    }
+    csr.linesByStation.finish();
+}
+
+// --relabel: renumbers stations and lines, then rebuilds the membership
+// graphs (and metroGraph when it is built) under the new ids: the
+// station rows, which are short, are permuted and resorted, and
+// stationsByLine is their transpose, which needs no sort. Bfs numbers
+// every component from the station found last by a first search from
+// its lowest station, a cheap pseudo-peripheral start that keeps the
+// levels narrow: a dequeued station numbers its new lines and queues
+// their new stations, so lines sharing stations, and the stations of a
+// line, get nearby ids. The answer does not depend on the ids; the
+// per-line outputs and station queries map them back.
+void Information::relabel(){
+    const CsrAdjacency& linesOf = csr.linesByStation;
+    const CsrAdjacency& stationsOf = csr.stationsByLine;
+    originalStation.assign(numStations + 1, 0);
+    originalLine.assign(numLines + 1, 0);
+    if (options.relabel == Relabeling::Degree){
+        std::iota(originalStation.begin(), originalStation.end(), 0);
+        std::iota(originalLine.begin(), originalLine.end(), 0);
+        std::stable_sort(originalStation.begin() + 1, originalStation.end(), [&](int a, int b){
+            return linesOf[a].size() > linesOf[b].size();
+        });
+        std::stable_sort(originalLine.begin() + 1, originalLine.end(), [&](int a, int b){
+            return stationsOf[a].size() > stationsOf[b].size();
+        });
+    } else {
+        ArenaAllocator<int> allocator(&arena);
+        ArenaVector<int> stationMark(numStations + 1, 0, allocator), lineMark(numLines + 1, 0, allocator);
+        int stamp = 0;
+        // Appends the stations reached from root, and their lines, to the
+        // two arrays; returns how many of each.
+        auto search = [&](int root, int* stations, int* lines, int& numFound){
+            stamp++;
+            int tail = 0;
+            numFound = 0;
+            stations[tail++] = root;
+            stationMark[root] = stamp;
+            for (int head = 0; head < tail; head++){
+                for (int line : linesOf[stations[head]]){
+                    if (lineMark[line] == stamp){
+                        continue;
+                    }
+                    lineMark[line] = stamp;
+                    lines[numFound++] = line;
+                    for (int station : stationsOf[line]){
+                        if (stationMark[station] != stamp){
+                            stationMark[station] = stamp;
+                            stations[tail++] = station;
+                        }
+                    }
+                }
+            }
+            return tail;
+        };
+        int placedStations = 1, placedLines = 1;
+        for (int station = 1; station <= numStations; station++){
+            if (stationMark[station]){
+                continue;
+            }
+            int* stations = originalStation.data() + placedStations;
+            int* lines = originalLine.data() + placedLines;
+            int found = 0;
+            int reached = search(station, stations, lines, found);
+            reached = search(stations[reached - 1], stations, lines, found);
+            placedStations += reached;
+            placedLines += found;
+        }
+        for (int line = 1; line <= numLines; line++){
+            if (!lineMark[line]){
+                originalLine[placedLines++] = line;
+            }
+        }
+    }
+    newStation.assign(numStations + 1, 0);
+    newLine.assign(numLines + 1, 0);
+    for (int k = 1; k <= numStations; k++){
+        newStation[originalStation[k]] = k;
+    }
+    for (int k = 1; k <= numLines; k++){
+        newLine[originalLine[k]] = k;
+    }
+
+    CsrAdjacency stationsByLine, linesByStation, metroGraph;
+    stationsByLine.setArena(&arena);
+    linesByStation.setArena(&arena);
+    metroGraph.setArena(&arena);
+    linesByStation.permuteOf(linesOf, originalStation.data(), numStations + 1, newLine.data());
+    stationsByLine.transposeOf(linesByStation, nullptr, numStations + 1, nullptr, numLines + 1);
+    if (csr.metroGraph.rows() > 0){
+        metroGraph.permuteOf(csr.metroGraph, originalStation.data(), numStations + 1, newStation.data());
+        csr.metroGraph = std::move(metroGraph);
+    }
+    csr.stationsByLine = std::move(stationsByLine);
+    csr.linesByStation = std::move(linesByStation);
+}
+
+void Information::printMetroGraph() {
+    std::cout << "Graph representation:\n";
+    for (int station = 1; station <= numStations; ++station) {
+        std::cout << "Station " << station << " is connected to stations: ";
+        if (options.layout == GraphLayout::Csr){
+            for (int adjStation : csr.metroGraph[station]) {
+                std::cout << adjStation << " ";
+            }
+        } else {
+            for (int adjStation : graphs.metroGraph[station]) {
+                std::cout << adjStation << " ";
+            }
+        }
+        std::cout << "\n";
+    }
+}
+
+void Information::printLinesGraph() {
+    std::cout << "Lines graph representation:\n";
+    for (int line = 1; line <= numLines; ++line) {
+        std::cout << "Line " << line << " connects to lines: ";
+        if (options.layout == GraphLayout::Csr){
+            for (int adjLine : csr.linesGraph[line]) {
+                std::cout << adjLine << " ";
+            }
+        } else {
+            for (int adjLine : graphs.linesGraph[line]) {
+                std::cout << adjLine << " ";
+            }
+        }
+        std::cout << "\n";
+    }
+}
+
+bool Information::isolatedStationsExist() {
+    for (int station = 1; station <= numStations; station++) {
+        bool isolated = options.layout == GraphLayout::Csr
+            ? csr.metroGraph[station].empty()
+            : graphs.metroGraph[station].empty();
+        if (isolated) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Direction-optimizing BFS from station 1 (Beamer et al.). Levels are
+// slices of one array queue. A level is expanded top-down while its
+// arcs are few next to the arcs of the stations not reached yet, and
+// bottom-up otherwise: every unreached station looks for any neighbour
+// in the frontier bitmap and stops at the first one, which on dense
+// networks skips most arcs of the big middle levels. It goes back to
+// top-down once the frontier shrinks again.
+template <typename Adjacency>
+bool Information::stationsReachable(const Adjacency& metroGraph){
+    const long long alpha = 14, beta = 24;
+    ArenaAllocator<int> allocator(options.layout == GraphLayout::Csr ? &arena : nullptr);
+    ArenaVector<int> visited(numStations + 1, 0, allocator);
+    ArenaVector<int> queue(numStations, 0, allocator);
+    ArenaVector<uint64_t> frontier(numStations / 64 + 1, 0, ArenaAllocator<uint64_t>(allocator));
+    long long unexploredArcs = 0;
+    for (int station = 1; station <= numStations; station++){
+        unexploredArcs += metroGraph[station].size();
+    }
+    int head = 0, tail = 0;
+    queue[tail++] = 1;
+    visited[1] = 1;
+    bool bottomUp = false;
+    PROFILE_COUNT(long long edges = 0);
+    while (head < tail){
+        int levelEnd = tail;
+        long long frontierArcs = 0;
+        for (int k = head; k < levelEnd; k++){
+            frontierArcs += metroGraph[queue[k]].size();
+        }
+        unexploredArcs -= frontierArcs;
+        if (!bottomUp && frontierArcs * alpha > unexploredArcs){
+            bottomUp = true;
+        } else if (bottomUp && (long long)(levelEnd - head) * beta < numStations){
+            bottomUp = false;
+        }
+        if (bottomUp){
+            for (int k = head; k < levelEnd; k++){
+                frontier[queue[k] >> 6] |= 1ULL << (queue[k] & 63);
+            }
+            for (int station = 1; station <= numStations; station++){
+                if (visited[station]){
+                    continue;
+                }
+                for (int adjStation : metroGraph[station]){
+                    PROFILE_COUNT(edges++);
+                    if (frontier[adjStation >> 6] >> (adjStation & 63) & 1){
+                        visited[station] = 1;
+                        queue[tail++] = station;
+                        break;
+                    }
+                }
+            }
+            for (int k = head; k < levelEnd; k++){
+                frontier[queue[k] >> 6] = 0;
+            }
+        } else {
+            PROFILE_COUNT(edges += frontierArcs);
+            for (int k = head; k < levelEnd; k++){
+                for (int adjStation : metroGraph[queue[k]]){
+                    if (!visited[adjStation]){
+                        visited[adjStation] = 1;
+                        queue[tail++] = adjStation;
+                    }
+                }
+            }
+        }
+        head = levelEnd;
+    }
+    PROFILE_COUNT(profile.edgesScanned += edges);
+    PROFILE_COUNT(profile.nodesExpanded += tail);
+    return tail == numStations;
+}
+
+bool Information::systemBFS(){
+
+    //printLinesByStation();
+
+    if (options.layout == GraphLayout::Csr){
+        return stationsReachable(csr.metroGraph);
+    }
+    return stationsReachable(graphs.metroGraph);
+}
+
+// Collects into row the non-contained lines sharing a station with line,
+// each once: mark[adjLine] == line flags the lines already emitted.
+template <typename Adjacency, typename Scratch>
+void Information::adjacentLines(int line, const Adjacency& stationsByLine, const Adjacency& linesByStation,
+                                Scratch& mark, Scratch& row){
+    row.clear();
+    mark[line] = line;
+    for (int station : stationsByLine[line]){
+        PROFILE_COUNT(profile.edgesScanned += linesByStation[station].size());
+        for (int adjLine : linesByStation[station]){
+            if (mark[adjLine] != line && !graphs.lineContainedInAnotherLine[adjLine]){
+                mark[adjLine] = line;
+                row.push_back(adjLine);
+            }
+        }
+    }
+}
+
+// Line graph stage, run once the stations are known to be connected.
+// Every row is produced from its own line, so each line pair is emitted
+// once per direction instead of once per shared station.
+void Information::buildLinesGraph(){
+    ArenaAllocator<int> allocator(options.layout == GraphLayout::Csr ? &arena : nullptr);
+    ArenaVector<int> mark(numLines + 1, 0, allocator);
+    ArenaVector<int> row(allocator);
+    row.reserve(numLines);
+    if (options.layout == GraphLayout::Csr){
+        // No line has more than L - 1 neighbours, and a station on k lines
+        // contributes at most k(k-1) arcs, so this reserve is never exceeded.
+        size_t bound = 0;
+        for (int station = 1; station <= numStations; station++){
+            size_t k = csr.linesByStation[station].size();
+            bound += k * (k - 1);
+        }
+        bound = std::min(bound, (size_t)numLines * std::max(numLines - 1, 0));
+        csr.linesGraph.offsets.reserve(numLines + 2);
+        csr.linesGraph.offsets.assign(1, 0);
+        csr.linesGraph.targets.reserve(bound);
+        for (int line = 0; line <= numLines; line++){
+            row.clear();
+            if (line > 0 && !graphs.lineContainedInAnotherLine[line]){
+                adjacentLines(line, csr.stationsByLine, csr.linesByStation, mark, row);
+                std::sort(row.begin(), row.end());
+            }
+            csr.linesGraph.appendRow(row);
+        }
+    } else {
+        for (int line = 1; line <= numLines; line++){
+            if (!graphs.lineContainedInAnotherLine[line]){
+                adjacentLines(line, graphs.stationsByLine, graphs.linesByStation, mark, row);
+                graphs.linesGraph[line].insert(row.begin(), row.end());
+            }
+        }
+    }
+}
+
+// BFS from source using caller owned scratch: distances must be -1 for
+// every vertex of the component on entry, queue needs one slot per vertex.
+// Leaves the distances in place and returns how many vertices were
+// reached, listed in visit order at the front of queue.
+template <typename Adjacency>
+static int bfsReach(const Adjacency& graph, int source, int* distances, int* queue,
+                    long long& edges, long long& nodes){
+#ifndef PROFILE_COUNTERS
+    (void)edges;
+    (void)nodes;
+#endif
+    int head = 0, tail = 0;
+    queue[tail++] = source;
+    distances[source] = 0;
+    while (head < tail){
+        int vertex = queue[head++];
+        int nextDistance = distances[vertex] + 1;
+        PROFILE_COUNT(edges += graph[vertex].size());
+        for (int adj : graph[vertex]){
+            if (distances[adj] < 0){
+                distances[adj] = nextDistance;
+                queue[tail++] = adj;
+            }
+        }
+    }
+    PROFILE_COUNT(nodes += tail);
+    return tail;
+}
+
+// Same search as bfsReach(), but distances is restored before returning.
+// Returns the eccentricity of source within its component.
+template <typename Adjacency>
+static int bfsEccentricity(const Adjacency& graph, int source, int* distances, int* queue,
+                           long long& edges, long long& nodes){
+    int tail = bfsReach(graph, source, distances, queue, edges, nodes);
+    int eccentricity = distances[queue[tail - 1]];
+    for (int k = 0; k < tail; k++){
+        distances[queue[k]] = -1;
+    }
+    return eccentricity;
+}
+
+// One BFS per line, spread over the worker threads in chunks of source
+// lines; each thread keeps its own scratch and maximum.
+template <typename Adjacency>
+static int maxLineChanges(const Adjacency& linesGraph, int numLines, int threads, Arena* arena, Profile* profile){
+    int numThreads = std::min(resolveThreads(threads), std::max(numLines, 1));
+    const int chunk = 16;
+    std::atomic<int> nextLine(1);
+    std::vector<int> threadMax(numThreads, 0);
+    runWorkers(numThreads, [&](int t){
+        ArenaVector<int> distances(numLines + 1, -1, ArenaAllocator<int>(arena));
+        ArenaVector<int> queue(numLines + 1, 0, ArenaAllocator<int>(arena));
+        int maxDistance = 0;
+        long long edges = 0, nodes = 0;
+        for (;;){
+            int first = nextLine.fetch_add(chunk);
+            if (first > numLines){
+                break;
+            }
+            int last = std::min(first + chunk - 1, numLines);
+            for (int i = first; i <= last; i++){
+                maxDistance = std::max(maxDistance, bfsEccentricity(linesGraph, i, distances.data(), queue.data(), edges, nodes));
+            }
+        }
+        PROFILE_COUNT(profile->edgesScanned += edges);
+        PROFILE_COUNT(profile->nodesExpanded += nodes);
+        threadMax[t] = maxDistance;
+    });
+    profile->bfsRuns += numLines;
+    return *std::max_element(threadMax.begin(), threadMax.end());
+}
+
+// Multi-source bit-parallel BFS: every line carries one bit per source of
+// the current batch, and a level is expanded by OR-ing the frontier words
+// of the neighbours. The last level that discovers a line for a source
+// is that source's eccentricity.
+template <typename Adjacency>
+static void bitsetEccentricities(const Adjacency& linesGraph, int numLines, const std::vector<int>& sources,
+                                 int* eccentricity, int threads, Arena* arena, Profile* profile){
+    const int words = 4;
+    const int batchSize = 64 * words;
+    int numSources = sources.size();
+    int numBatches = (numSources + batchSize - 1) / batchSize;
+    int numThreads = std::max(1, std::min(resolveThreads(threads), numBatches));
+    std::atomic<int> nextBatch(0);
+    runWorkers(numThreads, [&](int){
+        ArenaAllocator<uint64_t> allocator(arena);
+        ArenaVector<uint64_t> visited((numLines + 1) * words, 0, allocator);
+        ArenaVector<uint64_t> frontier((numLines + 1) * words, 0, allocator);
+        ArenaVector<uint64_t> next((numLines + 1) * words, 0, allocator);
+        PROFILE_COUNT(long long edges = 0);
+        PROFILE_COUNT(long long nodes = 0);
+        for (int batch = nextBatch++; batch < numBatches; batch = nextBatch++){
+            const int* batchSources = &sources[batch * batchSize];
+            int count = std::min(batchSize, numSources - batch * batchSize);
+            // Bits past the last source start out visited so that lines can
+            // be skipped as soon as every real source has reached them.
+            uint64_t unused[words];
+            for (int w = 0; w < words; w++){
+                int bits = std::min(std::max(count - 64 * w, 0), 64);
+                unused[w] = bits == 64 ? 0 : ~0ULL << bits;
+            }
+            for (int line = 1; line <= numLines; line++){
+                for (int w = 0; w < words; w++){
+                    visited[line * words + w] = unused[w];
+                    frontier[line * words + w] = 0;
+                }
+            }
+            for (int k = 0; k < count; k++){
+                int line = batchSources[k];
+                visited[line * words + k / 64] |= 1ULL << (k % 64);
+                frontier[line * words + k / 64] |= 1ULL << (k % 64);
+                eccentricity[line] = 0;
+            }
+            int level = 0;
+            for (;;){
+                uint64_t any[words] = {0};
+                for (int line = 1; line <= numLines; line++){
+                    uint64_t* lineVisited = &visited[line * words];
+                    uint64_t* lineNext = &next[line * words];
+                    uint64_t full = ~0ULL;
+                    for (int w = 0; w < words; w++){
+                        full &= lineVisited[w];
+                    }
+                    uint64_t reached[words] = {0};
+                    if (full != ~0ULL){
+                        PROFILE_COUNT(edges += linesGraph[line].size());
+                        PROFILE_COUNT(nodes++);
+                        for (int adjLine : linesGraph[line]){
+                            const uint64_t* adjFrontier = &frontier[adjLine * words];
+                            for (int w = 0; w < words; w++){
+                                reached[w] |= adjFrontier[w];
+                            }
+                        }
+                    }
+                    for (int w = 0; w < words; w++){
+                        reached[w] &= ~lineVisited[w];
+                        lineNext[w] = reached[w];
+                        lineVisited[w] |= reached[w];
+                        any[w] |= reached[w];
+                    }
+                }
+                bool grew = false;
+                level++;
+                for (int w = 0; w < words; w++){
+                    for (uint64_t bits = any[w]; bits; bits &= bits - 1){
+                        eccentricity[batchSources[64 * w + __builtin_ctzll(bits)]] = level;
+                        grew = true;
+                    }
+                }
+                if (!grew){
+                    break;
+                }
+                frontier.swap(next);
+            }
+        }
+        PROFILE_COUNT(profile->edgesScanned += edges);
+        PROFILE_COUNT(profile->nodesExpanded += nodes);
+    });
+    profile->bfsRuns += numSources;
+}
+
+// The bit-parallel BFS from every line at once, 256 sources per pass.
+template <typename Adjacency>
+static int maxLineChangesBitset(const Adjacency& linesGraph, int numLines, int threads, Arena* arena, Profile* profile){
+    std::vector<int> sources(numLines), eccentricity(numLines + 1, 0);
+    std::iota(sources.begin(), sources.end(), 1);
+    bitsetEccentricities(linesGraph, numLines, sources, eccentricity.data(), threads, arena, profile);
+    return *std::max_element(eccentricity.begin(), eccentricity.end());
+}
+
+// Where --approximate stops the bounds engine: after maxRuns searches or
+// past the deadline, whichever comes first (0 / untimed: no limit). It is
+// checked between rounds, so a search in flight always completes.
+struct DiameterBudget {
+    long long maxRuns = 0;
+    bool timed = false;
+    std::chrono::steady_clock::time_point deadline;
+
+    bool exhausted(long long runs) const {
+        return (maxRuns > 0 && runs >= maxRuns) || (timed && std::chrono::steady_clock::now() >= deadline);
+    }
+};
+
+// Eccentricity bounds of lines 0..L carried between bounds engine runs on
+// graphs that changed in between: the engine starts from them and leaves
+// its own final bounds in them. 0 and INT_MAX are always valid.
+struct EccentricityBounds {
+    std::vector<int> lower;
+    std::vector<int> upper;
+};
+
+// Exact diameter from eccentricity bounds (Takes and Kosters): a BFS from
+// v with eccentricity e bounds every w of its component by
+// max(d(v,w), e - d(v,w)) <= ecc(w) <= e + d(v,w), and the diameter by
+// [max ecc found, 2e]. Lines whose upper bound is no more than the best
+// lower bound can no longer change the answer and are dropped; the rest
+// are searched alternating the largest upper and the smallest lower
+// bound, one source per worker thread per round. Components are solved
+// one after the other, each starting from the BFS that discovers it.
+// With a budget the search may stop early: the result is then only a
+// lower bound, and upperBound receives a proven upper bound, the largest
+// upper bound left on a line (at most 2e for any searched v). Every
+// component still gets its first search, and the second one is the far
+// end of the first, so a budget of two runs is a double sweep. With
+// known bounds the search starts from them instead of [0, infinity].
+template <typename Adjacency>
+static int maxLineChangesBounds(const Adjacency& linesGraph, int numLines, int threads, Arena* arena, Profile* profile,
+                                const DiameterBudget* budget = nullptr, int* upperBound = nullptr,
+                                EccentricityBounds* known = nullptr){
+    int numThreads = std::min(resolveThreads(threads), std::max(numLines, 1));
+    ArenaAllocator<int> allocator(arena);
+    ArenaVector<int> lower(numLines + 1, 0, allocator);
+    ArenaVector<int> upper(numLines + 1, std::numeric_limits<int>::max(), allocator);
+    if (known){
+        std::copy(known->lower.begin(), known->lower.end(), lower.begin());
+        std::copy(known->upper.begin(), known->upper.end(), upper.begin());
+    }
+    ArenaVector<char> seen(numLines + 1, 0, ArenaAllocator<char>(arena));
+    ArenaVector<int> candidates(allocator);
+    candidates.reserve(numLines);
+    std::vector<ArenaVector<int>> distances, queues;
+    for (int t = 0; t < numThreads; t++){
+        distances.emplace_back(numLines + 1, -1, allocator);
+        queues.emplace_back(numLines + 1, 0, allocator);
+    }
+    std::vector<int> sources, eccentricities(numThreads), reached(numThreads);
+    std::vector<long long> edges(numThreads, 0), nodes(numThreads, 0);
+    long long runs = 0;
+    int diameter = 0, diameterUpper = 0;
+    for (int start = 1; start <= numLines; start++){
+        if (seen[start] || linesGraph[start].empty()){
+            continue;
+        }
+        sources.assign(1, start);
+        int low = 0, high = std::numeric_limits<int>::max();
+        bool pickUpper = true;
+        bool first = true;
+        while (!sources.empty()){
+            int batch = sources.size();
+            runWorkers(batch, [&](int t){
+                reached[t] = bfsReach(linesGraph, sources[t], distances[t].data(), queues[t].data(),
+                                      edges[t], nodes[t]);
+                eccentricities[t] = distances[t][queues[t][reached[t] - 1]];
+            });
+            runs += batch;
+            if (first){
+                // Every line the first search reaches is a candidate.
+                candidates.assign(queues[0].begin(), queues[0].begin() + reached[0]);
+                for (int line : candidates){
+                    seen[line] = 1;
+                }
+                first = false;
+            }
+            for (int t = 0; t < batch; t++){
+                int eccentricity = eccentricities[t];
+                const int* distance = distances[t].data();
+                low = std::max(low, eccentricity);
+                high = std::min(high, 2 * eccentricity);
+                for (int line : candidates){
+                    int d = distance[line];
+                    lower[line] = std::max(lower[line], std::max(d, eccentricity - d));
+                    upper[line] = std::min(upper[line], eccentricity + d);
+                    low = std::max(low, lower[line]);
+                }
+                for (int k = 0; k < reached[t]; k++){
+                    distances[t][queues[t][k]] = -1;
+                }
+            }
+            candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                            [&](int line){ return upper[line] <= low; }),
+                             candidates.end());
+            sources.clear();
+            if (low >= high || (budget && budget->exhausted(runs))){
+                break;
+            }
+            long long allowed = budget && budget->maxRuns > 0 ? budget->maxRuns - runs : numThreads;
+            for (int t = 0; t < numThreads && t < allowed && (size_t)t < candidates.size(); t++){
+                int best = -1;
+                for (int line : candidates){
+                    if (std::find(sources.begin(), sources.end(), line) != sources.end()){
+                        continue;
+                    }
+                    if (best < 0 || (pickUpper ? upper[line] > upper[best] : lower[line] < lower[best])){
+                        best = line;
+                    }
+                }
+                sources.push_back(best);
+                pickUpper = !pickUpper;
+            }
+        }
+        int componentUpper = low;
+        for (int line : candidates){
+            componentUpper = std::max(componentUpper, upper[line]);
+        }
+        candidates.clear();
+        diameter = std::max(diameter, low);
+        diameterUpper = std::max(diameterUpper, std::min(high, componentUpper));
+    }
+    if (upperBound){
+        *upperBound = diameterUpper;
+    }
+    if (known){
+        std::copy(lower.begin(), lower.end(), known->lower.begin());
+        std::copy(upper.begin(), upper.end(), known->upper.begin());
+    }
+    for (int t = 0; t < numThreads; t++){
+        PROFILE_COUNT(profile->edgesScanned += edges[t]);
+        PROFILE_COUNT(profile->nodesExpanded += nodes[t]);
+    }
+    profile->bfsRuns += runs;
+    return diameter;
+}
+
+static const char lineEccentricitiesMagic[8] = {'A', 'S', 'A', '2', 'E', 'C', 'C', '\n'};
+static const char lineDistancesMagic[8] = {'A', 'S', 'A', '2', 'D', 'S', 'T', '\n'};
+
+static void appendNumber(std::string& text, int value){
+    char digits[12];
+    int n = 0;
+    unsigned x = value < 0 ? -(unsigned)value : value;
+    do {
+        digits[n++] = '0' + x % 10;
+        x /= 10;
+    } while (x);
+    if (value < 0){
+        text += '-';
+    }
+    while (n){
+        text += digits[--n];
+    }
+}
+
+// Writes every distance and eccentricity of the line graph while finding
+// its diameter, with the same one-BFS-per-line work as maxLineChanges().
+// Sources go in windows of 16 per thread: each window's rows are filled
+// in parallel, then written in line order, so only one window of the
+// matrix is ever in memory. Rows and eccentricities cover lines 1..L;
+// contained lines (not in the line graph) have eccentricity -1 and reach
+// only themselves, unreachable pairs are -1. CSV writes a "line,
+// eccentricity" header and one comma separated row per line; binary
+// writes an 8 byte magic, int32 L and int32 values. Rows and columns are
+// in input line ids: newLine and originalLine map them to the graph's
+// ids and back after --relabel (null otherwise).
+template <typename Adjacency>
+static int writeLineDistances(const Adjacency& linesGraph, int numLines, const std::vector<bool>& contained,
+                              int threads, LineDistanceOutput& output, Arena* arena, Profile* profile,
+                              const int* newLine = nullptr, const int* originalLine = nullptr){
+    int numThreads = std::min(resolveThreads(threads), std::max(numLines, 1));
+    int window = 16 * numThreads;
+    size_t rowSize = numLines;
+    std::vector<int> rows(output.distances ? window * rowSize : 0);
+    std::vector<int> eccentricity(numLines + 1, -1);
+    std::vector<ArenaVector<int>> distances, queues;
+    for (int t = 0; t < numThreads; t++){
+        distances.emplace_back(numLines + 1, -1, ArenaAllocator<int>(arena));
+        queues.emplace_back(numLines + 1, 0, ArenaAllocator<int>(arena));
+    }
+    std::vector<long long> edges(numThreads, 0), nodes(numThreads, 0);
+    int32_t count = numLines;
+    if (output.distances && output.binary){
+        std::fwrite(lineDistancesMagic, 1, sizeof(lineDistancesMagic), output.distances);
+        std::fwrite(&count, sizeof(count), 1, output.distances);
+    }
+    std::string text;
+    for (int first = 1; first <= numLines; first += window){
+        if (output.distances && std::ferror(output.distances)){
+            break; // disk full or pipe closed: the caller reports it
+        }
+        int last = std::min(numLines, first + window - 1);
+        std::atomic<int> nextLine(first);
+        runWorkers(numThreads, [&](int t){
+            int* distance = distances[t].data();
+            int* queue = queues[t].data();
+            for (int line = nextLine++; line <= last; line = nextLine++){
+                int source = newLine ? newLine[line] : line;
+                int reached = bfsReach(linesGraph, source, distance, queue, edges[t], nodes[t]);
+                eccentricity[line] = contained[source] ? -1 : distance[queue[reached - 1]];
+                if (output.distances){
+                    int* row = &rows[(line - first) * rowSize];
+                    std::fill(row, row + rowSize, -1);
+                    for (int k = 0; k < reached; k++){
+                        row[(originalLine ? originalLine[queue[k]] : queue[k]) - 1] = distance[queue[k]];
+                    }
+                }
+                for (int k = 0; k < reached; k++){
+                    distance[queue[k]] = -1;
+                }
+            }
+        });
+        if (!output.distances){
+            continue;
+        }
+        if (output.binary){
+            std::fwrite(rows.data(), sizeof(int), (last - first + 1) * rowSize, output.distances);
+            continue;
+        }
+        for (int line = first; line <= last; line++){
+            const int* row = &rows[(line - first) * rowSize];
+            text.clear();
+            for (size_t k = 0; k < rowSize; k++){
+                if (k){
+                    text += ',';
+                }
+                appendNumber(text, row[k]);
+            }
+            text += '\n';
+            std::fwrite(text.data(), 1, text.size(), output.distances);
+        }
+    }
+    if (output.eccentricities && output.binary){
+        std::fwrite(lineEccentricitiesMagic, 1, sizeof(lineEccentricitiesMagic), output.eccentricities);
+        std::fwrite(&count, sizeof(count), 1, output.eccentricities);
+        std::fwrite(eccentricity.data() + 1, sizeof(int), numLines, output.eccentricities);
+    } else if (output.eccentricities){
+        text = "line,eccentricity\n";
+        for (int line = 1; line <= numLines; line++){
+            appendNumber(text, line);
+            text += ',';
+            appendNumber(text, eccentricity[line]);
+            text += '\n';
+        }
+        std::fwrite(text.data(), 1, text.size(), output.eccentricities);
+    }
+    for (int t = 0; t < numThreads; t++){
+        PROFILE_COUNT(profile->edgesScanned += edges[t]);
+        PROFILE_COUNT(profile->nodesExpanded += nodes[t]);
+    }
+    profile->bfsRuns += numLines;
+    return std::max(0, *std::max_element(eccentricity.begin(), eccentricity.end()));
+}
+
+// Largest line change count of linesGraph with the given engine.
+template <typename Adjacency>
+static int lineGraphDiameter(const Adjacency& linesGraph, int numLines, const SolverOptions& options,
+                             Arena* arena = nullptr, Profile* profile = nullptr){
+    Profile unused;
+    if (!profile){
+        profile = &unused;
+    }
+    if (options.engine == DiameterEngine::Bitset){
+        return maxLineChangesBitset(linesGraph, numLines, options.numThreads, arena, profile);
+    }
+    if (options.engine == DiameterEngine::Bounds){
+        return maxLineChangesBounds(linesGraph, numLines, options.numThreads, arena, profile);
+    }
+    return maxLineChanges(linesGraph, numLines, options.numThreads, arena, profile);
+}
+
+int Information::resultsBFS(){
+    if (options.approximate && !distanceOutput){
+        DiameterBudget budget;
+        budget.maxRuns = options.sweeps;
+        budget.timed = options.budgetMs > 0;
+        budget.deadline = started + std::chrono::milliseconds(options.budgetMs);
+        int lower = 0, upper = 0;
+        if (options.layout == GraphLayout::Csr){
+            lower = maxLineChangesBounds(csr.linesGraph, reducedLines >= 0 ? reducedLines : numLines,
+                                         options.numThreads, &arena, &profile, &budget, &upper);
+        } else {
+            lower = maxLineChangesBounds(graphs.linesGraph, numLines, options.numThreads, nullptr, &profile,
+                                         &budget, &upper);
+        }
+        upperBound = std::max(twinDistance, upper);
+        return std::max(twinDistance, lower);
+    }
+    if (distanceOutput){
+        const std::vector<bool>& contained = graphs.lineContainedInAnotherLine;
+        if (options.layout == GraphLayout::Csr){
+            return writeLineDistances(csr.linesGraph, numLines, contained, options.numThreads,
+                                      *distanceOutput, &arena, &profile,
+                                      newLine.empty() ? nullptr : newLine.data(),
+                                      originalLine.empty() ? nullptr : originalLine.data());
+        }
+        return writeLineDistances(graphs.linesGraph, numLines, contained, options.numThreads,
+                                  *distanceOutput, nullptr, &profile);
+    }
+    if (options.layout == GraphLayout::Csr && reducedLines >= 0){
+        return std::max(twinDistance, lineGraphDiameter(csr.linesGraph, reducedLines, options, &arena, &profile));
+    }
+    if (options.layout == GraphLayout::Csr){
+        return lineGraphDiameter(csr.linesGraph, numLines, options, &arena, &profile);
+    }
+    return lineGraphDiameter(graphs.linesGraph, numLines, options, nullptr, &profile);
+}
+
+// Order independent hash of a line's neighbours: the sum of a mix of
+// every neighbour, so a closed neighbourhood hashes to the open one plus
+// the line's own mix.
+static uint64_t mixLine(int line){
+    uint64_t x = (uint64_t)line * 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Collapses twin lines of the line graph, which only changes the answer
+// by a known constant. Lines with the same neighbours (false twins, at
+// distance 2) or the same neighbours counting themselves (true twins,
+// adjacent) are at the same distance from every other line, so removing
+// one of a pair leaves every other distance alone, and the diameter is
+// the reduced graph's, or the twins' distance if larger. Contained lines,
+// isolated in the line graph, go too. Candidates are grouped by a
+// neighbourhood hash and compared exactly; rounds repeat while they
+// merge something, since a merge can turn two more lines into twins.
+// csr.linesGraph is compacted in place to lines 1..reducedLines.
+void Information::mergeTwinLines(){
+    ArenaAllocator<int> allocator(&arena);
+    int numVertices = numLines;
+    ArenaVector<uint64_t> key(numVertices + 1, 0, ArenaAllocator<uint64_t>(allocator));
+    ArenaVector<int> order(allocator), newId(numVertices + 1, 0, allocator);
+    order.reserve(numVertices);
+    int kept = 0;
+    for (int line = 1; line <= numLines; line++){
+        if (!graphs.lineContainedInAnotherLine[line]){
+            newId[line] = ++kept;
+        }
+    }
+    csr.linesGraph.compact(newId.data(), kept);
+    numVertices = kept;
+    profile.lineGraphLines = numVertices;
+    CsrAdjacency& graph = csr.linesGraph;
+    // Are the neighbourhoods of a and b equal once each drops the other?
+    auto sameNeighbours = [&](int a, int b){
+        CsrRow rowA = graph[a], rowB = graph[b];
+        const int* x = rowA.begin();
+        const int* y = rowB.begin();
+        for (;;){
+            while (x != rowA.end() && *x == b){
+                x++;
+            }
+            while (y != rowB.end() && *y == a){
+                y++;
+            }
+            if (x == rowA.end() || y == rowB.end()){
+                return x == rowA.end() && y == rowB.end();
+            }
+            if (*x++ != *y++){
+                return false;
+            }
+        }
+    };
+    for (bool merged = numVertices > 1; merged; ){
+        merged = false;
+        std::fill(newId.begin(), newId.begin() + numVertices + 1, 1);
+        newId[0] = 0;
+        for (int closed = 0; closed < 2; closed++){
+            order.clear();
+            for (int line = 1; line <= numVertices; line++){
+                if (!newId[line]){
+                    continue;
+                }
+                uint64_t hash = closed ? mixLine(line) : 0;
+                for (int adjLine : graph[line]){
+                    hash += mixLine(adjLine);
+                }
+                key[line] = hash;
+                order.push_back(line);
+            }
+            std::sort(order.begin(), order.end(), [&](int a, int b){
+                return key[a] != key[b] ? key[a] < key[b] : a < b;
+            });
+            for (size_t first = 0, last; first < order.size(); first = last){
+                for (last = first + 1; last < order.size() && key[order[last]] == key[order[first]]; last++){
+                }
+                for (size_t k = first + 1; k < last; k++){
+                    int line = order[k];
+                    for (size_t r = first; r < k; r++){
+                        int twin = order[r];
+                        if (!newId[twin]){
+                            continue;
+                        }
+                        bool adjacent = std::binary_search(graph[line].begin(), graph[line].end(), twin);
+                        if (adjacent == (closed == 1) && sameNeighbours(line, twin)){
+                            newId[line] = 0;
+                            twinDistance = std::max(twinDistance, closed ? 1 : 2);
+                            merged = true;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        if (merged){
+            kept = 0;
+            for (int line = 1; line <= numVertices; line++){
+                newId[line] = newId[line] ? ++kept : 0;
+            }
+            graph.compact(newId.data(), kept);
+            numVertices = kept;
+        }
+    }
+    reducedLines = numVertices;
+    profile.reducedLines = numVertices;
+}
+
+static bool isSubset(const std::unordered_set<int>& smaller, const std::unordered_set<int>& larger){
+    for (int station : smaller){
+        if (larger.find(station) == larger.end()){
+            return false;
+        }
+    }
+    return true;
+}
+
+// Set kernels over sorted, duplicate free int32 arrays (CSR rows): does
+// a intersect b, |a & b|, and is a a subset of b. Each kernel is one
+// merge scan; the SIMD ones compare a block of a against a block of b
+// all-pairs (4x4 with SSE2, 8x8 with AVX2) and advance the block with
+// the smaller maximum. The widest kernel the CPU supports is picked at
+// run time, and very skewed pairs gallop through the larger array instead.
+enum class SetOp { Intersects, Count, Subset };
+
+typedef size_t (*SetScan)(const int* a, size_t na, const int* b, size_t nb, SetOp op);
+
+struct SetKernel {
+    const char* name;
+    SetScan scan;
+};
+
+static size_t scalarSetScan(const int* a, size_t na, const int* b, size_t nb, SetOp op){
+    size_t i = 0, j = 0, count = 0;
+    while (i < na && j < nb){
+        if (a[i] < b[j]){
+            if (op == SetOp::Subset){
+                return 0;
+            }
+            i++;
+        } else if (a[i] > b[j]){
+            j++;
+        } else {
+            if (op == SetOp::Intersects){
+                return 1;
+            }
+            count++;
+            i++;
+            j++;
+        }
+    }
+    return op == SetOp::Subset ? i == na : count;
+}
+
+// Looks every element of a up in b with an exponential then binary search
+// starting where the previous one ended: O(na log(nb / na)).
+static size_t gallopSetScan(const int* a, size_t na, const int* b, size_t nb, SetOp op){
+    size_t j = 0, count = 0;
+    for (size_t i = 0; i < na; i++){
+        size_t low = j, high = j, step = 1;
+        while (high < nb && b[high] < a[i]){
+            low = high + 1;
+            high += step;
+            step <<= 1;
+        }
+        j = std::lower_bound(b + low, b + std::min(high + 1, nb), a[i]) - b;
+        if (j < nb && b[j] == a[i]){
+            if (op == SetOp::Intersects){
+                return 1;
+            }
+            count++;
+            j++;
+        } else if (op == SetOp::Subset){
+            return 0;
+        }
+    }
+    return op == SetOp::Subset ? 1 : count;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Both block kernels leave the block of a being matched (and the block of
+// b it started at) to scalarSetScan() once either array runs out of blocks.
+__attribute__((target("sse2")))
+static size_t sseSetScan(const int* a, size_t na, const int* b, size_t nb, SetOp op){
+    size_t i = 0, j = 0, blockStart = 0, count = 0;
+    unsigned matched = 0;
+    while (i + 4 <= na && j + 4 <= nb){
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+        __m128i eq = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi32(va, vb), _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39))),
+            _mm_or_si128(_mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4E)),
+                         _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93))));
+        matched |= _mm_movemask_ps(_mm_castsi128_ps(eq));
+        if (op == SetOp::Intersects && matched){
+            return 1;
+        }
+        bool nextA = a[i + 3] <= b[j + 3];
+        bool nextB = b[j + 3] <= a[i + 3];
+        if (nextA){
+            if (op == SetOp::Subset && matched != 0xF){
+                return 0;
+            }
+            count += __builtin_popcount(matched);
+            matched = 0;
+            i += 4;
+        }
+        if (nextB){
+            j += 4;
+        }
+        if (nextA){
+            blockStart = j;
+        }
+    }
+    size_t tail = scalarSetScan(a + i, na - i, b + blockStart, nb - blockStart, op);
+    return op == SetOp::Count ? count + tail : tail;
+}
+
+__attribute__((target("avx2")))
+static size_t avx2SetScan(const int* a, size_t na, const int* b, size_t nb, SetOp op){
+    const __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    size_t i = 0, j = 0, blockStart = 0, count = 0;
+    unsigned matched = 0;
+    while (i + 8 <= na && j + 8 <= nb){
+        __m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i*)(b + j));
+        __m256i eq = _mm256_cmpeq_epi32(va, vb);
+        for (int k = 1; k < 8; k++){
+            vb = _mm256_permutevar8x32_epi32(vb, rotate);
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(va, vb));
+        }
+        matched |= _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+        if (op == SetOp::Intersects && matched){
+            return 1;
+        }
+        bool nextA = a[i + 7] <= b[j + 7];
+        bool nextB = b[j + 7] <= a[i + 7];
+        if (nextA){
+            if (op == SetOp::Subset && matched != 0xFF){
+                return 0;
+            }
+            count += __builtin_popcount(matched);
+            matched = 0;
+            i += 8;
+        }
+        if (nextB){
+            j += 8;
+        }
+        if (nextA){
+            blockStart = j;
+        }
+    }
+    size_t tail = scalarSetScan(a + i, na - i, b + blockStart, nb - blockStart, op);
+    return op == SetOp::Count ? count + tail : tail;
+}
+#endif
+
+// Kernels this CPU can run, narrowest first.
+static std::vector<SetKernel> supportedSetKernels(){
+    std::vector<SetKernel> kernels(1, SetKernel{"scalar", scalarSetScan});
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")){
+        kernels.push_back(SetKernel{"sse2", sseSetScan});
+    }
+    if (__builtin_cpu_supports("avx2")){
+        kernels.push_back(SetKernel{"avx2", avx2SetScan});
+    }
+#endif
+    return kernels;
+}
+
+static SetScan bestSetScan(){
+    static const SetScan scan = supportedSetKernels().back().scan;
+    return scan;
+}
+
+static size_t sortedSetScan(const int* a, size_t na, const int* b, size_t nb, SetOp op){
+    if (op == SetOp::Subset){
+        if (na == 0){
+            return 1;
+        }
+        if (na > nb || a[0] < b[0] || a[na - 1] > b[nb - 1]){
+            return 0;
+        }
+    } else {
+        if (na == 0 || nb == 0 || a[na - 1] < b[0] || b[nb - 1] < a[0]){
+            return 0;
+        }
+        if (na > nb){
+            std::swap(a, b);
+            std::swap(na, nb);
+        }
+    }
+    if (nb / 32 > na){
+        return gallopSetScan(a, na, b, nb, op);
+    }
+    return bestSetScan()(a, na, b, nb, op);
+}
+
+static inline bool sortedIntersects(const int* a, size_t na, const int* b, size_t nb){
+    return sortedSetScan(a, na, b, nb, SetOp::Intersects) != 0;
+}
+
+// True when every element of a is in b.
+static inline bool sortedIsSubset(const int* a, size_t na, const int* b, size_t nb){
+    return sortedSetScan(a, na, b, nb, SetOp::Subset) != 0;
+}
+
+// Station set of every line as a sparse bitmap: the non-empty 64-station
+// blocks of a line, sorted by block index, each with its bit word. Each
+// line also keeps its size, min/max station and a 64-bit signature (one
+// hashed bit per station) so most subset tests fail before the words.
+// Lines averaging under 4 stations per block are compared with the
+// sorted set kernels on their CSR rows instead, which wins when sparse.
+struct LineBitmaps {
+    const CsrAdjacency* stationsByLine = nullptr; // must outlive the bitmaps
+    ArenaVector<int> blockOffsets;
+    ArenaVector<int> blockIds;
+    ArenaVector<uint64_t> blockWords;
+    ArenaVector<uint64_t> signature;
+    ArenaVector<int> minStation;
+    ArenaVector<int> maxStation;
+    ArenaVector<int> size;
+
+    explicit LineBitmaps(Arena* arena = nullptr)
+        : blockOffsets(ArenaAllocator<int>(arena)), blockIds(ArenaAllocator<int>(arena)),
+          blockWords(ArenaAllocator<uint64_t>(arena)), signature(ArenaAllocator<uint64_t>(arena)),
+          minStation(ArenaAllocator<int>(arena)), maxStation(ArenaAllocator<int>(arena)),
+          size(ArenaAllocator<int>(arena)) {}
+
+    void build(const CsrAdjacency& stationsByLine, int numLines){
+        this->stationsByLine = &stationsByLine;
+        blockOffsets.reserve(numLines + 2);
+        blockOffsets.assign(1, 0);
+        blockIds.clear();
+        blockWords.clear();
+        blockIds.reserve(stationsByLine.arcs());
+        blockWords.reserve(stationsByLine.arcs());
+        signature.assign(numLines + 1, 0);
+        minStation.assign(numLines + 1, 0);
+        maxStation.assign(numLines + 1, 0);
+        size.assign(numLines + 1, 0);
+        for (int line = 0; line <= numLines; line++){
+            CsrRow stations = stationsByLine[line];
+            for (int station : stations){
+                int block = station >> 6;
+                if (blockIds.size() == (size_t)blockOffsets.back() || blockIds.back() != block){
+                    blockIds.push_back(block);
+                    blockWords.push_back(0);
+                }
+                blockWords.back() |= 1ULL << (station & 63);
+                signature[line] |= 1ULL << ((uint32_t)station * 2654435761u >> 26);
+            }
+            blockOffsets.push_back(blockIds.size());
+            size[line] = stations.size();
+            if (!stations.empty()){
+                minStation[line] = *stations.begin();
+                maxStation[line] = *(stations.end() - 1);
+            }
+        }
+    }
+
+    bool isSubset(int smaller, int larger) const {
+        if (size[smaller] > size[larger]){
+            return false;
+        }
+        if (size[smaller] == 0){
+            return true;
+        }
+        if ((signature[smaller] & ~signature[larger]) != 0
+            || minStation[smaller] < minStation[larger]
+            || maxStation[smaller] > maxStation[larger]){
+            return false;
+        }
+        if (size[smaller] < 4 * (blockOffsets[smaller + 1] - blockOffsets[smaller])){
+            CsrRow smallerRow = (*stationsByLine)[smaller];
+            CsrRow largerRow = (*stationsByLine)[larger];
+            return sortedIsSubset(smallerRow.first, smallerRow.size(), largerRow.first, largerRow.size());
+        }
+        const int* largerIds = blockIds.data() + blockOffsets[larger];
+        const int* largerEnd = blockIds.data() + blockOffsets[larger + 1];
+        for (int k = blockOffsets[smaller]; k < blockOffsets[smaller + 1]; k++){
+            largerIds = std::lower_bound(largerIds, largerEnd, blockIds[k]);
+            if (largerIds == largerEnd || *largerIds != blockIds[k]){
+                return false;
+            }
+            uint64_t largerWord = blockWords[largerIds - blockIds.data()];
+            if ((blockWords[k] & ~largerWord) != 0){
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+template <typename Adjacency>
+void Information::markContainedLines(const Adjacency& stationsByLine){
+    for (int i = 1; i <= numLines; i++){
+        for (int j = 1; j <= numLines; j++){
+            if (i != j){
+                if (stationsByLine[i].size() <= stationsByLine[j].size()){
+                    PROFILE_COUNT(profile.subsetTests++);
+                    bool contained = isSubset(stationsByLine[i], stationsByLine[j]);
+                    if (contained && !graphs.lineContainedInAnotherLine[j]){
+                        graphs.lineContainedInAnotherLine[i] = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Same rule as markContainedLines(): line i is contained when some other
+// line j, not itself contained already, holds all of its stations. The
+// lines are tried in the input order, order[k] being the k-th line's id
+// when they were renumbered, so the same twin lines are marked.
+static void markBitmapContainedLines(const LineBitmaps& bitmaps, int numLines, std::vector<bool>& contained,
+                                     Profile* profile = nullptr, const int* order = nullptr){
+#ifndef PROFILE_COUNTERS
+    (void)profile;
+#endif
+    PROFILE_COUNT(long long tests = 0);
+    for (int a = 1; a <= numLines; a++){
+        int i = order ? order[a] : a;
+        for (int b = 1; b <= numLines; b++){
+            int j = order ? order[b] : b;
+            if (i != j && !contained[j]){
+                PROFILE_COUNT(tests++);
+                if (bitmaps.isSubset(i, j)){
+                    contained[i] = true;
+                    break;
+                }
+            }
+        }
+    }
+    PROFILE_COUNT(if (profile) profile->subsetTests += tests);
+}
+
+void Information::checkContainedLines(){
+    if (options.layout == GraphLayout::Csr){
+        LineBitmaps bitmaps(&arena);
+        bitmaps.build(csr.stationsByLine, numLines);
+        markBitmapContainedLines(bitmaps, numLines, graphs.lineContainedInAnotherLine, &profile,
+                                 newLine.empty() ? nullptr : newLine.data());
+        return;
+    }
+    markContainedLines(graphs.stationsByLine);
+}
+
+// Network kept alive by --serve. Connections are reference counted so an
+// update only touches the two stations and the line involved: station
+// links, line membership and the line graph (as shared station counts per
+// line pair) are maintained directly. Connectivity is kept in a
+// union-find; a removed link is only checked at the next query, with a
+// search from both of its ends that stops as soon as they meet. Which
+// lines are contained is the order free form of markContainedLines():
+// line i is contained when a neighbour j covers it, sharing all of i's
+// stations and having more of them, or as many and j > i. Every line
+// keeps how many lines cover it, and an update only recounts the pairs of
+// the line it changed, from the shared counts.
+// The diameter is found with the bounds engine, starting from the bounds
+// it left last time when they still hold: while lines only gain stations
+// and no line leaves the contained set, distances only shrink and the
+// old upper bounds stand; while lines only lose stations and no line
+// joins the contained set, the old lower bounds stand. When lines only
+// lose stations, a line x also keeps its upper bound if it is as far
+// from both ends of every removed line graph edge: then no shortest path
+// from x used one, so none of its distances changed. Only the lines
+// whose bounds can still change the answer are then searched.
+class IncrementalNetwork {
+private:
+    struct ConnectionKey {
+        int u;
+        int v;
+        int line;
+
+        bool operator==(const ConnectionKey& other) const {
+            return u == other.u && v == other.v && line == other.line;
+        }
+    };
+
+    struct ConnectionKeyHash {
+        size_t operator()(const ConnectionKey& key) const {
+            uint64_t h = (uint64_t)key.u * 0x9E3779B97F4A7C15ULL;
+            h ^= (uint64_t)key.v * 0xC2B2AE3D27D4EB4FULL + (h << 6) + (h >> 2);
+            h ^= (uint64_t)key.line * 0x165667B19E3779F9ULL + (h << 6) + (h >> 2);
+            return h;
+        }
+    };
+
+    int numStations;
+    int numLines;
+    SolverOptions options;
+    std::unordered_map<ConnectionKey, int, ConnectionKeyHash> connections;
+    std::vector<std::unordered_map<int, int>> stationLinks; // adjacent station -> connections
+    std::vector<std::unordered_map<int, int>> lineStations; // station -> connections of the line at it
+    std::vector<std::vector<int>> stationLines; // unordered, a station is on few lines
+    std::unordered_map<uint64_t, int> sharedStations; // line pair -> stations in common
+    std::vector<std::vector<int>> lineAdjacency; // unordered
+    int isolatedStations;
+
+    std::vector<int> parent;
+    int components;
+    bool connectivityStale = false;
+    std::vector<std::pair<int, int>> cutLinks; // links gone since the last query
+    std::vector<int> searchMark; // 2 * searchStamp from one end, + 1 from the other
+    int searchStamp = 0;
+
+    std::vector<int> covers; // lines covering each line
+    std::vector<int> dirtyLines; // lines whose containment may have changed
+    std::vector<bool> dirty;
+    std::vector<bool> contained;
+    bool linesGrew = false;
+    bool linesShrank = false;
+    bool linesContained = false; // a line joined the contained set
+    bool linesFreed = false; // a line left it
+    std::vector<std::pair<int, int>> cutPairs; // line graph edges gone, up to maxCutPairs
+    bool cutOverflow = false;
+    bool diameterStale = true;
+    EccentricityBounds bounds;
+    int diameter = 0;
+
+    static const size_t maxCutPairs = 16;
+
+    static uint64_t linePair(int line1, int line2) {
+        if (line1 > line2) {
+            std::swap(line1, line2);
+        }
+        return (uint64_t)line1 << 32 | (uint32_t)line2;
+    }
+
+    int findRoot(int station);
+    void unite(int u, int v);
+    void link(int u, int v);
+    bool unlink(int u, int v);
+    void markDirty(int line);
+    bool coveredBy(int line, int other, int shared) const;
+    void countCovers(int line, int delta);
+    void joinLine(int station, int line);
+    void leaveLine(int station, int line);
+    bool stillLinked(int u, int v);
+    void rebuildConnectivity();
+    void recheckContainment();
+    void rebuildDiameter();
+
+public:
+    IncrementalNetwork(int numStations, int numLines, const SolverOptions& options);
+    void load(const std::vector<Connection>& initial);
+    bool add(int u, int v, int line);
+    bool remove(int u, int v, int line);
+    int query();
+};
+
+IncrementalNetwork::IncrementalNetwork(int numStations, int numLines, const SolverOptions& options)
+    : numStations(numStations), numLines(numLines), options(options),
+      stationLinks(numStations + 1), lineStations(numLines + 1), stationLines(numStations + 1),
+      lineAdjacency(numLines + 1), isolatedStations(numStations), parent(numStations + 1),
+      components(numStations), searchMark(numStations + 1, 0), covers(numLines + 1, 0), dirty(numLines + 1, false),
+      contained(numLines + 1, false) {
+    std::iota(parent.begin(), parent.end(), 0);
+    bounds.lower.assign(numLines + 1, 0);
+    bounds.upper.assign(numLines + 1, std::numeric_limits<int>::max());
+}
+
+int IncrementalNetwork::findRoot(int station){
+    while (parent[station] != station){
+        parent[station] = parent[parent[station]];
+        station = parent[station];
+    }
+    return station;
+}
+
+void IncrementalNetwork::unite(int u, int v){
+    u = findRoot(u);
+    v = findRoot(v);
+    if (u != v){
+        parent[u] = v;
+        components--;
+    }
+}
+
+void IncrementalNetwork::link(int u, int v){
+    if (stationLinks[u].empty()){
+        isolatedStations--;
+    }
+    stationLinks[u][v]++;
+    if (u != v){
+        if (stationLinks[v].empty()){
+            isolatedStations--;
+        }
+        stationLinks[v][u]++;
+    }
+    if (!connectivityStale){
+        unite(u, v);
+    }
+}
+
+// Returns true when u and v are no longer directly connected.
+bool IncrementalNetwork::unlink(int u, int v){
+    bool gone = false;
+    auto it = stationLinks[u].find(v);
+    if (--it->second == 0){
+        stationLinks[u].erase(it);
+        gone = true;
+    }
+    if (stationLinks[u].empty()){
+        isolatedStations++;
+    }
+    if (u != v){
+        it = stationLinks[v].find(u);
+        if (--it->second == 0){
+            stationLinks[v].erase(it);
+        }
+        if (stationLinks[v].empty()){
+            isolatedStations++;
+        }
+    }
+    return gone;
+}
+
+void IncrementalNetwork::markDirty(int line){
+    if (!dirty[line]){
+        dirty[line] = true;
+        dirtyLines.push_back(line);
+    }
+}
+
+bool IncrementalNetwork::coveredBy(int line, int other, int shared) const {
+    int size = lineStations[line].size();
+    int otherSize = lineStations[other].size();
+    return shared == size && (otherSize > size || (otherSize == size && other > line));
+}
+
+// Adds delta to the cover counts of every pair of line and a neighbour.
+void IncrementalNetwork::countCovers(int line, int delta){
+    markDirty(line);
+    for (int other : lineAdjacency[line]){
+        int shared = sharedStations.find(linePair(line, other))->second;
+        if (coveredBy(line, other, shared)){
+            covers[line] += delta;
+        }
+        if (coveredBy(other, line, shared)){
+            covers[other] += delta;
+            markDirty(other);
+        }
+    }
+}
+
+// Only the pairs of the line change: its size and its shared counts with
+// the other lines at the station, so just those covers are recounted.
+void IncrementalNetwork::joinLine(int station, int line){
+    auto it = lineStations[line].find(station);
+    if (it != lineStations[line].end()){
+        it->second++;
+        return;
+    }
+    countCovers(line, -1);
+    lineStations[line][station] = 1;
+    for (int other : stationLines[station]){
+        if (sharedStations[linePair(line, other)]++ == 0){
+            lineAdjacency[line].push_back(other);
+            lineAdjacency[other].push_back(line);
+            diameterStale = true;
+        }
+    }
+    stationLines[station].push_back(line);
+    countCovers(line, 1);
+    linesGrew = true;
+}
+
+static void eraseUnordered(std::vector<int>& items, int item){
+    *std::find(items.begin(), items.end(), item) = items.back();
+    items.pop_back();
+}
+
+void IncrementalNetwork::leaveLine(int station, int line){
+    auto it = lineStations[line].find(station);
+    if (--it->second > 0){
+        return;
+    }
+    countCovers(line, -1);
+    lineStations[line].erase(it);
+    eraseUnordered(stationLines[station], line);
+    for (int other : stationLines[station]){
+        auto shared = sharedStations.find(linePair(line, other));
+        if (--shared->second == 0){
+            sharedStations.erase(shared);
+            eraseUnordered(lineAdjacency[line], other);
+            eraseUnordered(lineAdjacency[other], line);
+            if (cutPairs.size() < maxCutPairs){
+                cutPairs.emplace_back(line, other);
+            } else {
+                cutOverflow = true;
+            }
+            diameterStale = true;
+        }
+    }
+    countCovers(line, 1);
+    linesShrank = true;
+}
+
+// Bulk version of add() for the initial network: membership is filled
+// first and the shared station counts of each line are then gathered in a
+// dense array, instead of one hash update per line pair per station.
+void IncrementalNetwork::load(const std::vector<Connection>& initial){
+    for (const Connection& c : initial){
+        if (c.u < 1 || c.u > numStations || c.v < 1 || c.v > numStations || c.line < 1 || c.line > numLines){
+            continue;
+        }
+        if (connections[ConnectionKey{std::min(c.u, c.v), std::max(c.u, c.v), c.line}]++ > 0){
+            continue;
+        }
+        if (stationLinks[c.u].empty()){
+            isolatedStations--;
+        }
+        stationLinks[c.u][c.v]++;
+        if (c.u != c.v){
+            if (stationLinks[c.v].empty()){
+                isolatedStations--;
+            }
+            stationLinks[c.v][c.u]++;
+        }
+        lineStations[c.line][c.u]++;
+        if (c.u != c.v){
+            lineStations[c.line][c.v]++;
+        }
+    }
+    for (int line = 1; line <= numLines; line++){
+        for (const auto& station : lineStations[line]){
+            stationLines[station.first].push_back(line);
+        }
+    }
+    std::vector<int> shared(numLines + 1, 0);
+    std::vector<int> touched;
+    for (int line = 1; line <= numLines; line++){
+        for (const auto& station : lineStations[line]){
+            for (int other : stationLines[station.first]){
+                if (other > line && shared[other]++ == 0){
+                    touched.push_back(other);
+                }
+            }
+        }
+        for (int other : touched){
+            sharedStations[linePair(line, other)] = shared[other];
+            lineAdjacency[line].push_back(other);
+            lineAdjacency[other].push_back(line);
+            covers[line] += coveredBy(line, other, shared[other]);
+            covers[other] += coveredBy(other, line, shared[other]);
+            shared[other] = 0;
+        }
+        touched.clear();
+        markDirty(line);
+    }
+    connectivityStale = true;
+    diameterStale = true;
+}
+
+bool IncrementalNetwork::add(int u, int v, int line){
+    if (u < 1 || u > numStations || v < 1 || v > numStations || line < 1 || line > numLines){
+        return false;
+    }
+    if (connections[ConnectionKey{std::min(u, v), std::max(u, v), line}]++ > 0){
+        return true;
+    }
+    link(u, v);
+    joinLine(u, line);
+    if (v != u){
+        joinLine(v, line);
+    }
+    return true;
+}
+
+bool IncrementalNetwork::remove(int u, int v, int line){
+    auto it = connections.find(ConnectionKey{std::min(u, v), std::max(u, v), line});
+    if (it == connections.end()){
+        return false;
+    }
+    if (--it->second > 0){
+        return true;
+    }
+    connections.erase(it);
+    if (unlink(u, v) && u != v && !connectivityStale){
+        cutLinks.emplace_back(u, v);
+    }
+    leaveLine(u, line);
+    if (v != u){
+        leaveLine(v, line);
+    }
+    return true;
+}
+
+// Whether u and v are still connected: a search from each end, always
+// growing the one with the shorter queue, so a split costs about the
+// smaller side and a detour about the stations near the removed link.
+bool IncrementalNetwork::stillLinked(int u, int v){
+    if (searchStamp == std::numeric_limits<int>::max() / 2){
+        std::fill(searchMark.begin(), searchMark.end(), 0);
+        searchStamp = 0;
+    }
+    searchStamp++;
+    std::vector<int> queues[2] = {{u}, {v}};
+    size_t heads[2] = {0, 0};
+    searchMark[u] = 2 * searchStamp;
+    searchMark[v] = 2 * searchStamp + 1;
+    while (heads[0] < queues[0].size() && heads[1] < queues[1].size()){
+        int side = queues[0].size() - heads[0] <= queues[1].size() - heads[1] ? 0 : 1;
+        int station = queues[side][heads[side]++];
+        for (const auto& adj : stationLinks[station]){
+            int mark = searchMark[adj.first];
+            if (mark == 2 * searchStamp + 1 - side){
+                return true;
+            }
+            if (mark != 2 * searchStamp + side){
+                searchMark[adj.first] = 2 * searchStamp + side;
+                queues[side].push_back(adj.first);
+            }
+        }
+    }
+    return false;
+}
+
+// Recomputes the components with a BFS over the station links and
+// restarts the union-find from them.
+void IncrementalNetwork::rebuildConnectivity(){
+    std::vector<int> queue(numStations + 1);
+    std::fill(parent.begin(), parent.end(), 0);
+    components = 0;
+    for (int root = 1; root <= numStations; root++){
+        if (parent[root]){
+            continue;
+        }
+        components++;
+        int head = 0, tail = 0;
+        queue[tail++] = root;
+        parent[root] = root;
+        while (head < tail){
+            int station = queue[head++];
+            for (const auto& adj : stationLinks[station]){
+                if (!parent[adj.first]){
+                    parent[adj.first] = root;
+                    queue[tail++] = adj.first;
+                }
+            }
+        }
+    }
+    connectivityStale = false;
+}
+
+void IncrementalNetwork::recheckContainment(){
+    for (int line : dirtyLines){
+        dirty[line] = false;
+        // An empty line is only looked at once the network is connected,
+        // so some other line has stations.
+        bool now = lineStations[line].empty() || covers[line] > 0;
+        if (now != contained[line]){
+            contained[line] = now;
+            (now ? linesContained : linesFreed) = true;
+            bounds.lower[line] = 0;
+            bounds.upper[line] = std::numeric_limits<int>::max();
+            diameterStale = true;
+        }
+    }
+    dirtyLines.clear();
+}
+
+void IncrementalNetwork::rebuildDiameter(){
+    CsrAdjacency linesGraph;
+    linesGraph.offsets.assign(1, 0);
+    std::vector<int> row;
+    for (int line = 0; line <= numLines; line++){
+        row.clear();
+        if (line > 0 && !contained[line]){
+            for (int adjLine : lineAdjacency[line]){
+                if (!contained[adjLine]){
+                    row.push_back(adjLine);
+                }
+            }
+        }
+        linesGraph.appendRow(row);
+    }
+    const int unknown = std::numeric_limits<int>::max();
+    if (linesGrew || linesContained){
+        std::fill(bounds.lower.begin(), bounds.lower.end(), 0);
+    }
+    if (linesFreed || (linesGrew && linesShrank) || (linesShrank && (linesContained || cutOverflow))){
+        std::fill(bounds.upper.begin(), bounds.upper.end(), unknown);
+    } else if (linesShrank){
+        std::vector<int> fromFirst(numLines + 1, -1), fromSecond(numLines + 1, -1), queue(numLines + 1);
+        long long edges = 0, nodes = 0;
+        for (const auto& cut : cutPairs){
+            if (contained[cut.first] || contained[cut.second]){
+                continue;
+            }
+            bfsReach(linesGraph, cut.first, fromFirst.data(), queue.data(), edges, nodes);
+            bfsReach(linesGraph, cut.second, fromSecond.data(), queue.data(), edges, nodes);
+            for (int line = 1; line <= numLines; line++){
+                if (fromFirst[line] != fromSecond[line]){
+                    bounds.upper[line] = unknown;
+                }
+            }
+            std::fill(fromFirst.begin(), fromFirst.end(), -1);
+            std::fill(fromSecond.begin(), fromSecond.end(), -1);
+        }
+    }
+    linesGrew = linesShrank = linesContained = linesFreed = cutOverflow = false;
+    cutPairs.clear();
+    // On a small diameter a line's upper bound only drops to the answer
+    // after a search from the line itself, so past a few rounds the lines
+    // still open are settled with the bit-parallel BFS instead.
+    Profile profile;
+    DiameterBudget budget;
+    budget.maxRuns = 64;
+    int upper = 0;
+    diameter = maxLineChangesBounds(linesGraph, numLines, options.numThreads, nullptr, &profile, &budget, &upper,
+                                    &bounds);
+    if (upper > diameter){
+        std::vector<int> unsettled;
+        for (int line = 1; line <= numLines; line++){
+            if (!contained[line] && bounds.upper[line] > diameter){
+                unsettled.push_back(line);
+            }
+        }
+        bitsetEccentricities(linesGraph, numLines, unsettled, bounds.lower.data(), options.numThreads, nullptr, &profile);
+        for (int line : unsettled){
+            bounds.upper[line] = bounds.lower[line];
+        }
+        diameter = maxLineChangesBounds(linesGraph, numLines, options.numThreads, nullptr, &profile, nullptr, nullptr,
+                                        &bounds);
+    }
+    diameterStale = false;
+}
+
+// Same answer as a full Information solve of the current connections.
+int IncrementalNetwork::query(){
+    if (numStations == 1){
+        return 0;
+    }
+    if (isolatedStations > 0){
+        return -1;
+    }
+    if (!connectivityStale){
+        for (const auto& cut : cutLinks){
+            if (!stillLinked(cut.first, cut.second)){
+                connectivityStale = true;
+                break;
+            }
+        }
+    }
+    cutLinks.clear();
+    if (connectivityStale){
+        rebuildConnectivity();
+    }
+    if (components > 1){
+        return -1;
+    }
+    recheckContainment();
+    if (diameterStale){
+        rebuildDiameter();
+    }
+    return diameter;
+}
+
+// PROJETO2_NO_MAIN lets tools such as graph/set_kernels.cpp include this
+// file without the command line drivers from here on.
+#ifndef PROJETO2_NO_MAIN
+// Loads the network from path, then reads "add u v line",
+// "remove u v line" and "query" commands from stdin.
+static int runServe(const SolverOptions& options){
+    if (options.inputPaths.size() != 1){
+        std::cerr << "--serve reads commands from stdin and needs the network as one file argument\n";
+        return 1;
+    }
+    InputReader reader;
+    if (!reader.open(options.inputPaths[0])){
+        std::cerr << "Could not read input " << options.inputPaths[0] << "\n";
+        return 1;
+    }
+    if (BinaryGraph::isBinary(reader)){
+        std::cerr << "--serve needs a text input\n";
+        return 1;
+    }
+    InputCursor input = reader.cursor();
+    int numStations = 0, numConnections = 0, numLines = 0;
+    input.nextInt(numStations);
+    input.nextInt(numConnections);
+    input.nextInt(numLines);
+    std::vector<Connection> initial(numConnections);
+    for (int i = 0; i < numConnections; i++){
+        input.nextInt(initial[i].u);
+        input.nextInt(initial[i].v);
+        input.nextInt(initial[i].line);
+    }
+    IncrementalNetwork network(numStations, numLines, options);
+    network.load(initial);
+
+    std::string command;
+    while (std::cin >> command){
+        if (command == "query"){
+            std::cout << network.query() << std::endl;
+            continue;
+        }
+        int u, v, line;
+        if ((command != "add" && command != "remove") || !(std::cin >> u >> v >> line)){
+            std::cerr << "Unknown command: " << command << "\n";
+            std::cin.clear();
+            std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+            continue;
+        }
+        bool ok = command == "add" ? network.add(u, v, line) : network.remove(u, v, line);
+        if (!ok){
+            std::cerr << "Ignored " << command << " " << u << " " << v << " " << line << "\n";
+        }
+    }
+    return 0;
+}
+
+// Minimum number of line changes between two stations, the smallest
+// line graph distance between a line of one and a line of the other
+// (contained lines need no care: their stations are all on a line that
+// is in the line graph). Labels are built once: with the matrix every
+// line pair is stored; with landmarks (pruned landmark labeling, Akiba
+// et al.) each line keeps (hub, distance) pairs from BFS runs in
+// decreasing degree order that are pruned wherever the labels found so
+// far already give the distance. A station query then merges the labels
+// of the lines of its stations.
+class TransferOracle {
+private:
+    struct LabelEntry {
+        int hub; // hub rank
+        int distance;
+    };
+
+    const CsrAdjacency& linesByStation;
+    int numLines;
+    bool useMatrix;
+    std::vector<uint16_t> matrix; // (from - 1) * numLines + (to - 1), unreachable is noPath
+    std::vector<int> labelOffsets;
+    std::vector<LabelEntry> labels;
+    mutable std::vector<int> hubDistance; // query scratch, indexed by hub rank
+    mutable std::vector<int> touched;
+
+    static const uint16_t noPath = 0xFFFF;
+    static const int infinity = std::numeric_limits<int>::max() / 2;
+
+    void buildMatrix(const CsrAdjacency& linesGraph, int threads);
+    void buildLandmarks(const CsrAdjacency& linesGraph);
+
+public:
+    TransferOracle(const CsrAdjacency& linesByStation, const CsrAdjacency& linesGraph, int numLines,
+                   TransferLabels kind, int threads);
+    int query(int from, int to) const;
+    size_t labelBytes() const;
+    const char* kind() const { return useMatrix ? "matrix" : "landmarks"; }
+};
+
+const size_t IncrementalNetwork::maxCutPairs;
+const uint16_t TransferOracle::noPath;
+const int TransferOracle::infinity;
+
+TransferOracle::TransferOracle(const CsrAdjacency& linesByStation, const CsrAdjacency& linesGraph, int numLines,
+                               TransferLabels kind, int threads)
+    : linesByStation(linesByStation), numLines(numLines),
+      useMatrix(kind == TransferLabels::Matrix || (kind == TransferLabels::Auto && numLines <= 4096)) {
+    if (useMatrix){
+        buildMatrix(linesGraph, threads);
+    } else {
+        buildLandmarks(linesGraph);
+    }
+}
+
+void TransferOracle::buildMatrix(const CsrAdjacency& linesGraph, int threads){
+    size_t rowSize = numLines;
+    matrix.assign(rowSize * rowSize, noPath);
+    int numThreads = std::min(resolveThreads(threads), std::max(numLines, 1));
+    std::atomic<int> nextLine(1);
+    runWorkers(numThreads, [&](int){
+        std::vector<int> distances(numLines + 1, -1), queue(numLines + 1);
+        long long edges = 0, nodes = 0;
+        for (int line = nextLine++; line <= numLines; line = nextLine++){
+            int reached = bfsReach(linesGraph, line, distances.data(), queue.data(), edges, nodes);
+            uint16_t* row = &matrix[(line - 1) * rowSize];
+            for (int k = 0; k < reached; k++){
+                row[queue[k] - 1] = std::min<int>(distances[queue[k]], noPath - 1);
+                distances[queue[k]] = -1;
+            }
+        }
+    });
+}
+
+// Hubs go in decreasing order of degree times an estimated betweenness
+// (the summed sizes of the subtrees a line roots in the BFS trees of a
+// few evenly spread sample lines). Degree order alone gives path-like
+// line graphs, which metro networks often are, near linear labels.
+void TransferOracle::buildLandmarks(const CsrAdjacency& linesGraph){
+    const int samples = 16;
+    std::vector<int> distances(numLines + 1, -1), queue(numLines + 1), parent(numLines + 1);
+    std::vector<long long> subtree(numLines + 1, 0), centrality(numLines + 1, 0);
+    std::vector<int> order(numLines);
+    std::iota(order.begin(), order.end(), 1);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b){
+        return linesGraph[a].size() > linesGraph[b].size();
+    });
+    for (int sample = 0; sample < samples && sample < numLines; sample++){
+        int root = sample == 0 ? order[0] : 1 + (int)((long long)sample * numLines / samples);
+        int head = 0, tail = 0;
+        queue[tail++] = root;
+        distances[root] = 0;
+        parent[root] = 0;
+        while (head < tail){
+            int line = queue[head++];
+            for (int adjLine : linesGraph[line]){
+                if (distances[adjLine] < 0){
+                    distances[adjLine] = distances[line] + 1;
+                    parent[adjLine] = line;
+                    queue[tail++] = adjLine;
+                }
+            }
+        }
+        for (int k = tail - 1; k >= 0; k--){
+            int line = queue[k];
+            subtree[line] += 1;
+            centrality[line] += subtree[line];
+            subtree[parent[line]] += subtree[line];
+        }
+        for (int k = 0; k < tail; k++){
+            distances[queue[k]] = -1;
+            subtree[queue[k]] = 0;
+        }
+        subtree[0] = 0;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b){
+        return centrality[a] * (double)(linesGraph[a].size() + 1) > centrality[b] * (double)(linesGraph[b].size() + 1);
+    });
+    std::vector<std::vector<LabelEntry>> lineLabels(numLines + 1);
+    std::vector<int> rootDistance(numLines, infinity); // the root's label, by hub rank
+    for (int rank = 0; rank < numLines; rank++){
+        int root = order[rank];
+        for (const LabelEntry& entry : lineLabels[root]){
+            rootDistance[entry.hub] = entry.distance;
+        }
+        int head = 0, tail = 0;
+        queue[tail++] = root;
+        distances[root] = 0;
+        while (head < tail){
+            int line = queue[head++];
+            int distance = distances[line];
+            bool covered = false;
+            for (const LabelEntry& entry : lineLabels[line]){
+                if (rootDistance[entry.hub] + entry.distance <= distance){
+                    covered = true;
+                    break;
+                }
+            }
+            if (covered){
+                continue;
+            }
+            lineLabels[line].push_back(LabelEntry{rank, distance});
+            for (int adjLine : linesGraph[line]){
+                if (distances[adjLine] < 0){
+                    distances[adjLine] = distance + 1;
+                    queue[tail++] = adjLine;
+                }
+            }
+        }
+        for (int k = 0; k < tail; k++){
+            distances[queue[k]] = -1;
+        }
+        for (const LabelEntry& entry : lineLabels[root]){
+            rootDistance[entry.hub] = infinity;
+        }
+    }
+    labelOffsets.assign(2, 0); // line's entries are [labelOffsets[line], labelOffsets[line + 1])
+    for (int line = 1; line <= numLines; line++){
+        labels.insert(labels.end(), lineLabels[line].begin(), lineLabels[line].end());
+        labelOffsets.push_back(labels.size());
+    }
+    hubDistance.assign(numLines, infinity);
+}
+
+// -1 when no sequence of lines joins the two stations.
+int TransferOracle::query(int from, int to) const{
+    if (from == to){
+        return 0;
+    }
+    CsrRow fromLines = linesByStation[from];
+    CsrRow toLines = linesByStation[to];
+    if (fromLines.empty() || toLines.empty()){
+        return -1;
+    }
+    if (sortedIntersects(fromLines.first, fromLines.size(), toLines.first, toLines.size())){
+        return 0;
+    }
+    int best = infinity;
+    if (useMatrix){
+        for (int fromLine : fromLines){
+            const uint16_t* row = &matrix[(fromLine - 1) * (size_t)numLines];
+            for (int toLine : toLines){
+                best = std::min<int>(best, row[toLine - 1] == noPath ? infinity : row[toLine - 1]);
+            }
+        }
+        return best == infinity ? -1 : best;
+    }
+    for (int fromLine : fromLines){
+        for (int k = labelOffsets[fromLine]; k < labelOffsets[fromLine + 1]; k++){
+            if (hubDistance[labels[k].hub] == infinity){
+                touched.push_back(labels[k].hub);
+            }
+            hubDistance[labels[k].hub] = std::min(hubDistance[labels[k].hub], labels[k].distance);
+        }
+    }
+    for (int toLine : toLines){
+        for (int k = labelOffsets[toLine]; k < labelOffsets[toLine + 1]; k++){
+            best = std::min(best, hubDistance[labels[k].hub] + labels[k].distance);
+        }
+    }
+    for (int hub : touched){
+        hubDistance[hub] = infinity;
+    }
+    touched.clear();
+    return best >= infinity ? -1 : best;
+}
+
+size_t TransferOracle::labelBytes() const{
+    return matrix.size() * sizeof(uint16_t) + labels.size() * sizeof(LabelEntry)
+        + labelOffsets.size() * sizeof(int);
+}
+
+// --query: builds the labels for the network in the one file argument,
+// then answers "from to" station pairs read from stdin, one per line.
+static int runQueries(const SolverOptions& options){
+    if (options.inputPaths.size() != 1){
+        std::cerr << "--query reads station pairs from stdin and needs the network as one file argument\n";
+        return 1;
+    }
+    InputReader reader;
+    if (!reader.open(options.inputPaths[0])){
+        std::cerr << "Could not read input " << options.inputPaths[0] << "\n";
+        return 1;
+    }
+    if (BinaryGraph::isBinary(reader)){
+        std::cerr << "--query needs a text input\n";
+        return 1;
+    }
+    auto start = std::chrono::steady_clock::now();
+    InputCursor input = reader.cursor();
+    int numStations = 0, numConnections = 0, numLines = 0;
+    input.nextInt(numStations);
+    input.nextInt(numConnections);
+    input.nextInt(numLines);
+    Information info(options);
+    info.buildTransferGraphs(input, numStations, numConnections, numLines);
+    const CsrGraphs& csr = info.getCsrGraphs();
+    TransferOracle oracle(csr.linesByStation, csr.linesGraph, numLines, options.labels, options.numThreads);
+    double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    InputReader queries;
+    if (!queries.open(nullptr)){
+        std::cerr << "Could not read the queries\n";
+        return 1;
+    }
+    start = std::chrono::steady_clock::now();
+    InputCursor cursor = queries.cursor();
+    std::string out;
+    long long numQueries = 0;
+    int from, to;
+    while (cursor.nextInt(from) && cursor.nextInt(to)){
+        if (from < 1 || from > numStations || to < 1 || to > numStations){
+            out += "invalid\n";
+        } else {
+            out += std::to_string(oracle.query(info.relabeledStation(from), info.relabeledStation(to)));
+            out += '\n';
+        }
+        numQueries++;
+    }
+    double querySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << out;
+    if (options.stats){
+        std::cerr << "labels: " << oracle.kind() << ", built in " << buildSeconds * 1000 << " ms, "
+                  << oracle.labelBytes() / 1e6 << " MB\n";
+        std::cerr << "queries: " << numQueries << " in " << querySeconds * 1000 << " ms ("
+                  << (querySeconds > 0 ? numQueries / querySeconds : 0) << " per second)\n";
+    }
+    return 0;
+}
+
+static bool parseOptions(int argc, char* argv[], SolverOptions& options){
+    for (int i = 1; i < argc; i++){
+        if (std::strcmp(argv[i], "--layout=csr") == 0){
+            options.layout = GraphLayout::Csr;
+        } else if (std::strcmp(argv[i], "--layout=sets") == 0){
+            options.layout = GraphLayout::Sets;
+        } else if (std::strcmp(argv[i], "--stats") == 0 || std::strcmp(argv[i], "--parse-stats") == 0){
+            options.stats = true;
+        } else if (std::strcmp(argv[i], "--profile") == 0){
+            options.profile = true;
+        } else if (std::strcmp(argv[i], "--lean") == 0){
+            options.lean = true;
+            options.layout = GraphLayout::Csr;
+        } else if (std::strcmp(argv[i], "--engine=bfs") == 0){
+            options.engine = DiameterEngine::Bfs;
+        } else if (std::strcmp(argv[i], "--engine=bitset") == 0){
+            options.engine = DiameterEngine::Bitset;
+        } else if (std::strcmp(argv[i], "--engine=bounds") == 0){
+            options.engine = DiameterEngine::Bounds;
+        } else if (std::strcmp(argv[i], "--approximate") == 0){
+            options.approximate = true;
+        } else if (std::strncmp(argv[i], "--sweeps=", 9) == 0){
+            options.sweeps = std::max(0, std::atoi(argv[i] + 9));
+        } else if (std::strncmp(argv[i], "--budget-ms=", 12) == 0){
+            options.budgetMs = std::max(0, std::atoi(argv[i] + 12));
+        } else if (std::strncmp(argv[i], "--memory-mb=", 12) == 0){
+            options.memoryMb = std::max(1, std::atoi(argv[i] + 12));
+        } else if (std::strncmp(argv[i], "--temp-dir=", 11) == 0){
+            options.tempDir = argv[i] + 11;
+        } else if (std::strcmp(argv[i], "--reduce=twins") == 0){
+            options.reduce = LineReduction::Twins;
+        } else if (std::strcmp(argv[i], "--reduce=none") == 0){
+            options.reduce = LineReduction::None;
+        } else if (std::strcmp(argv[i], "--relabel=none") == 0){
+            options.relabel = Relabeling::None;
+        } else if (std::strcmp(argv[i], "--relabel=bfs") == 0){
+            options.relabel = Relabeling::Bfs;
+        } else if (std::strcmp(argv[i], "--relabel=degree") == 0){
+            options.relabel = Relabeling::Degree;
+        } else if (std::strncmp(argv[i], "--threads=", 10) == 0){
+            options.numThreads = std::atoi(argv[i] + 10);
+        } else if (std::strcmp(argv[i], "--batch") == 0){
+            options.batch = true;
+        } else if (std::strcmp(argv[i], "--serve") == 0){
+            options.serve = true;
+        } else if (std::strcmp(argv[i], "--query") == 0){
+            options.query = true;
+        } else if (std::strcmp(argv[i], "--labels=auto") == 0){
+            options.labels = TransferLabels::Auto;
+        } else if (std::strcmp(argv[i], "--labels=matrix") == 0){
+            options.labels = TransferLabels::Matrix;
+        } else if (std::strcmp(argv[i], "--labels=landmarks") == 0){
+            options.labels = TransferLabels::Landmarks;
+        } else if (std::strncmp(argv[i], "--jobs=", 7) == 0){
+            options.numJobs = std::max(1, std::atoi(argv[i] + 7));
+        } else if (std::strncmp(argv[i], "--convert=", 10) == 0){
+            options.convertPath = argv[i] + 10;
+        } else if (std::strncmp(argv[i], "--eccentricities=", 17) == 0){
+            options.eccentricitiesPath = argv[i] + 17;
+        } else if (std::strncmp(argv[i], "--distances=", 12) == 0){
+            options.distancesPath = argv[i] + 12;
+        } else if (std::strcmp(argv[i], "--distance-format=csv") == 0){
+            options.binaryDistances = false;
+        } else if (std::strcmp(argv[i], "--distance-format=binary") == 0){
+            options.binaryDistances = true;
+        } else if (argv[i][0] != '-'){
+            options.inputPaths.push_back(argv[i]);
+        } else {
+            std::cerr << "Unknown option: " << argv[i] << "\n";
+            std::cerr << "Usage: " << argv[0] << " [--layout=csr|sets] [--engine=bfs|bitset|bounds] [--threads=N]"
+                      << " [--batch] [--jobs=N] [--serve] [--query] [--labels=auto|matrix|landmarks]"
+                      << " [--convert=out.bin] [--lean] [--relabel=none|bfs|degree] [--reduce=twins|none]"
+                      << " [--eccentricities=out] [--distances=out] [--distance-format=csv|binary]"
+                      << " [--approximate] [--sweeps=N] [--budget-ms=N] [--memory-mb=N] [--temp-dir=DIR]"
+                      << " [--stats] [--profile] [input...]\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+struct Instance {
+    const InputReader* reader;
+    size_t offset; // start of the instance header
+    const BinaryGraph* graph; // set for binary inputs
+};
+
+// Finds where every instance starts by reading each header and skipping
+// its connections. A single instance per input unless batch is set; a
+// binary graph is always a single instance.
+static void findInstances(const InputReader& reader, const BinaryGraph* graph, bool batch,
+                          std::vector<Instance>& instances){
+    if (graph){
+        instances.push_back(Instance{&reader, 0, graph});
+        return;
+    }
+    InputCursor cursor = reader.cursor();
+    do {
+        size_t offset = reader.offsetOf(cursor);
+        int numStations, numConnections, numLines;
+        if (!cursor.nextInt(numStations) || !cursor.nextInt(numConnections) || !cursor.nextInt(numLines)){
+            return;
+        }
+        instances.push_back(Instance{&reader, offset, nullptr});
+        if (!cursor.skipInts(3LL * numConnections)){
+            return;
+        }
+    } while (batch);
+}
+
+static int solveInstance(Information& info, const Instance& instance){
+    if (instance.graph){
+        return info.solve(*instance.graph);
+    }
+    InputCursor cursor = instance.reader->cursor(instance.offset);
+    int numStations = 0, numConnections = 0, numLines = 0;
+    cursor.nextInt(numStations);
+    cursor.nextInt(numConnections);
+    cursor.nextInt(numLines);
+    return info.solve(cursor, numStations, numConnections, numLines);
+}
+
+// Solves every instance of every input and prints one answer per line.
+// Each job owns one Information, reused across the instances it takes.
+static int runBatch(const SolverOptions& options){
+    std::vector<const char*> paths = options.inputPaths;
+    if (paths.empty()){
+        paths.push_back(nullptr);
+    }
+    std::vector<InputReader> readers(paths.size());
+    std::vector<BinaryGraph> graphs(paths.size());
+    std::vector<Instance> instances;
+    for (size_t k = 0; k < paths.size(); k++){
+        const char* name = paths[k] ? paths[k] : "<stdin>";
+        if (!readers[k].open(paths[k], !options.lean)){
+            std::cerr << "Could not read input " << name << "\n";
+            return 1;
+        }
+        bool binary = BinaryGraph::isBinary(readers[k]);
+        std::string error;
+        if (binary && !graphs[k].open(readers[k], error)){
+            std::cerr << name << ": " << error << "\n";
+            return 1;
+        }
+        findInstances(readers[k], binary ? &graphs[k] : nullptr, options.batch, instances);
+    }
+
+    int numJobs = std::max(1, std::min<int>(options.numJobs, instances.size()));
+    SolverOptions jobOptions = options;
+    if (numJobs > 1){
+        jobOptions.numThreads = std::max(1, resolveThreads(options.numThreads) / numJobs);
+    }
+    std::vector<int> solutions(instances.size());
+    std::vector<std::string> profiles(options.profile ? instances.size() : 0);
+    std::atomic<size_t> nextInstance(0);
+    runWorkers(numJobs, [&](int){
+        Information info(jobOptions);
+        for (size_t k = nextInstance++; k < instances.size(); k = nextInstance++){
+            solutions[k] = solveInstance(info, instances[k]);
+            if (options.profile){
+                profiles[k] = info.profileJson();
+            }
+        }
+    });
+    for (int solution : solutions){
+        std::cout << solution << "\n";
+    }
+    for (const std::string& profile : profiles){
+        std::cerr << profile << "\n";
+    }
+    return 0;
+}
+
+// --convert: writes the single text input as a binary graph.
+static int runConvert(const SolverOptions& options){
+    if (options.inputPaths.size() > 1){
+        std::cerr << "--convert takes one input\n";
+        return 1;
+    }
+    const char* path = options.inputPaths.empty() ? nullptr : options.inputPaths[0];
+    InputReader reader;
+    if (!reader.open(path)){
+        std::cerr << "Could not read input " << (path ? path : "<stdin>") << "\n";
+        return 1;
+    }
+    if (BinaryGraph::isBinary(reader)){
+        std::cerr << "Input is already a binary graph\n";
+        return 1;
+    }
+    InputCursor input = reader.cursor();
+    int numStations = 0, numConnections = 0, numLines = 0;
+    input.nextInt(numStations);
+    input.nextInt(numConnections);
+    input.nextInt(numLines);
+    Information info(options);
+    if (!info.writeBinary(input, numStations, numConnections, numLines, options.convertPath)){
+        std::cerr << "Could not write " << options.convertPath << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(0);
+    std::cin.tie(0);
+
+    SolverOptions options;
+    if (!parseOptions(argc, argv, options)){
+        return 1;
+    }
+    if (options.serve){
+        return runServe(options);
+    }
+    if (options.query){
+        return runQueries(options);
+    }
+    if (options.convertPath){
+        return runConvert(options);
+    }
+    bool distanceOutput = options.eccentricitiesPath || options.distancesPath;
+    if (options.batch || options.inputPaths.size() > 1){
+        if (distanceOutput || options.approximate || options.memoryMb > 0){
+            std::cerr << "--eccentricities, --distances, --approximate and --memory-mb take a single instance\n";
+            return 1;
+        }
+        return runBatch(options);
+    }
+
+    const char* path = options.inputPaths.empty() ? nullptr : options.inputPaths[0];
+    InputReader reader;
+    if (!reader.open(path, !options.lean && options.memoryMb == 0)){
+        std::cerr << "Could not read input " << (path ? path : "<stdin>") << "\n";
+        return 1;
+    }
+    InputCursor input = reader.cursor();
+    Information info(options);
+    LineDistanceOutput output;
+    output.binary = options.binaryDistances;
+    const char* mode = options.binaryDistances ? "wb" : "w";
+    if (options.eccentricitiesPath && !(output.eccentricities = std::fopen(options.eccentricitiesPath, mode))){
+        std::cerr << "Could not write " << options.eccentricitiesPath << "\n";
+        return 1;
+    }
+    if (options.distancesPath && !(output.distances = std::fopen(options.distancesPath, mode))){
+        std::cerr << "Could not write " << options.distancesPath << "\n";
+        return 1;
+    }
+    if (distanceOutput){
+        info.setDistanceOutput(&output);
+    }
+    bool binary = BinaryGraph::isBinary(reader);
+    if (binary && options.memoryMb > 0){
+        std::cerr << "--memory-mb needs a text input\n";
+        return 1;
+    }
+    if (binary){
+        BinaryGraph graph;
+        std::string error;
+        if (!graph.open(reader, error)){
+            std::cerr << (path ? path : "<stdin>") << ": " << error << "\n";
+            return 1;
+        }
+        info.solve(graph);
+    } else {
+        int numStations = 0, numConnections = 0, numLines = 0;
+        input.nextInt(numStations);
+        input.nextInt(numConnections);
+        input.nextInt(numLines);
+        if (options.memoryMb == 0){
+            info.solve(input, numStations, numConnections, numLines);
+        } else if (!info.solveExternal(input, numStations, numConnections, numLines)){
+            std::cerr << "Could not write the temporary runs to "
+                      << (options.tempDir ? options.tempDir : std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp")
+                      << "\n";
+            return 1;
+        }
+    }
+
+    // A failed write (disk full, closed pipe) leaves the files truncated
+    // and may have cut the search short, so nothing is printed.
+    bool written = true;
+    for (FILE* file : {output.eccentricities, output.distances}){
+        if (file){
+            bool failed = std::ferror(file);
+            written = std::fclose(file) == 0 && !failed && written;
+        }
+    }
+    if (!written){
+        std::cerr << "Could not finish writing the line distances\n";
+        return 1;
+    }
+    if (options.approximate){
+        std::cout << info.getSolution() << " " << info.getUpperBound() << " "
+                  << (info.getSolution() == info.getUpperBound() ? "exact" : "approximate") << "\n";
+    } else {
+        std::cout << info.getSolution() << "\n";
+    }
+
+    if (options.profile){
+        std::cerr << info.profileJson() << "\n";
+    }
+    if (options.stats){
+        double megabytes = (binary ? reader.size() : reader.offsetOf(input)) / 1e6;
+        double seconds = info.getProfile().seconds[PhaseParse];
+        std::cerr << "parse: " << megabytes << " MB in " << seconds * 1000 << " ms ("
+                  << (seconds > 0 ? megabytes / seconds : 0) << " MB/s)\n";
+        const Profile& profile = info.getProfile();
+        std::cerr << "lines graph: " << profile.seconds[PhaseLinesGraph] * 1000 << " ms";
+        if (profile.reducedLines >= 0){
+            std::cerr << ", " << profile.lineGraphLines << " lines, " << profile.reducedLines << " after merging twins ("
+                      << 100.0 * (profile.lineGraphLines - profile.reducedLines) / std::max(profile.lineGraphLines, 1)
+                      << "% fewer)";
+        }
+        std::cerr << "\n";
+        if (options.memoryMb > 0){
+            std::cerr << "external: " << profile.spilledRuns << " runs, " << profile.spilledBytes / 1e6
+                      << " MB spilled\n";
+        }
+        const Arena& arena = info.getArena();
+        std::cerr << "arena: " << arena.getMallocs() << " mallocs, peak " << arena.getPeakBytes() / 1e6
+                  << " MB of " << arena.getCapacity() / 1e6 << " MB block\n";
+#ifdef COUNT_ALLOCATIONS
+        std::cerr << "heap: " << heapAllocations.load() << " allocations\n";
+#endif
+    }
     return 0;
 }
+#endif